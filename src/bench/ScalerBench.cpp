@@ -0,0 +1,239 @@
+#include "ScalerBench.h"
+
+#include <QFileInfo>
+#include <QJsonObject>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+#include "converter/AreaScaler.h"
+#include "converter/EncoderSettings.h"
+#include "converter/StreamingContext.h"
+
+namespace {
+constexpr auto OpenClipException = "Failed to open clip";
+constexpr auto OpenDecoderException = "Failed to open clip decoder";
+constexpr auto AllocateFrameException = "Failed to allocate frame";
+constexpr auto OpenScalerException = "Failed to create swscale context";
+constexpr auto ReferenceFlags = SWS_LANCZOS | SWS_ACCURATE_RND;
+constexpr auto OutputFormat = AV_PIX_FMT_YUV420P;
+
+struct InputContextDeleter {
+  void operator()(AVFormatContext* context) {
+    if (context)
+      avformat_close_input(&context);
+  }
+};
+
+using InputContextPtr = std::unique_ptr<AVFormatContext, InputContextDeleter>;
+
+struct Candidate {
+  QString name;
+  std::function<void(const AVFrame*, AVFrame*)> scale;
+  int64_t totalNs = 0;
+  double squaredError[3] = {};
+};
+
+AVFramePtr allocateFrame(int width, int height) {
+  auto frame = AVFramePtr(av_frame_alloc());
+  if (!frame) {
+    throw std::runtime_error(AllocateFrameException);
+  }
+  frame->format = OutputFormat;
+  frame->width = width;
+  frame->height = height;
+  if (av_frame_get_buffer(frame.get(), 0) < 0) {
+    throw std::runtime_error(AllocateFrameException);
+  }
+  return frame;
+}
+
+std::function<void(const AVFrame*, AVFrame*)> swsScaler(
+    const AVCodecContext* decoder,
+    int width,
+    int height,
+    int flags) {
+  auto context = std::shared_ptr<SwsContext>(
+      sws_getContext(decoder->width, decoder->height, decoder->pix_fmt, width,
+                     height, OutputFormat, flags, nullptr, nullptr, nullptr),
+      SwsContextDeleter());
+  if (!context) {
+    throw std::runtime_error(OpenScalerException);
+  }
+  const auto srcHeight = decoder->height;
+  return [context, srcHeight](const AVFrame* src, AVFrame* dst) {
+    sws_scale(context.get(), src->data, src->linesize, 0, srcHeight,
+              dst->data, dst->linesize);
+  };
+}
+
+std::function<void(const AVFrame*, AVFrame*)> areaScaler(
+    const AVCodecContext* decoder,
+    int width,
+    int height,
+    double sharpen,
+    AreaScaler::Isa isa) {
+  auto scaler = std::make_shared<AreaScaler>(decoder->width, decoder->height,
+                                             decoder->pix_fmt, width, height,
+                                             sharpen, isa);
+  return [scaler](const AVFrame* src, AVFrame* dst) {
+    scaler->scale(src, dst);
+  };
+}
+
+void addSquaredError(const AVFrame* reference,
+                     const AVFrame* frame,
+                     double (&squaredError)[3]) {
+  for (int plane = 0; plane < 3; ++plane) {
+    const auto width = plane == 0 ? frame->width : (frame->width + 1) / 2;
+    const auto height = plane == 0 ? frame->height : (frame->height + 1) / 2;
+    for (int y = 0; y < height; ++y) {
+      const auto* lhs = reference->data[plane] + y * reference->linesize[plane];
+      const auto* rhs = frame->data[plane] + y * frame->linesize[plane];
+      for (int x = 0; x < width; ++x) {
+        const double difference = lhs[x] - rhs[x];
+        squaredError[plane] += difference * difference;
+      }
+    }
+  }
+}
+
+double psnr(double squaredError, double samples) {
+  const auto mse = squaredError / samples;
+  return mse > 0 ? 10 * std::log10(255.0 * 255.0 / mse) : 100.0;
+}
+
+QJsonArray benchClip(const QString& clip,
+                     int width,
+                     int height,
+                     int maxFrames) {
+  const auto clipStd = clip.toStdString();
+  AVFormatContext* formatContext = nullptr;
+  if (avformat_open_input(&formatContext, clipStd.c_str(), nullptr,
+                          nullptr) != 0) {
+    throw std::runtime_error(OpenClipException);
+  }
+  auto input = InputContextPtr(formatContext);
+  if (avformat_find_stream_info(input.get(), nullptr) < 0) {
+    throw std::runtime_error(OpenClipException);
+  }
+
+  const AVCodec* codec = nullptr;
+  const auto index =
+      av_find_best_stream(input.get(), AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+  if (index < 0) {
+    throw std::runtime_error(OpenClipException);
+  }
+  auto decoder = AVCodecContextPtr(avcodec_alloc_context3(codec));
+  if (!decoder ||
+      avcodec_parameters_to_context(decoder.get(),
+                                    input->streams[index]->codecpar) < 0 ||
+      avcodec_open2(decoder.get(), codec, nullptr) < 0) {
+    throw std::runtime_error(OpenDecoderException);
+  }
+
+  std::vector<Candidate> candidates;
+  candidates.push_back(
+      {"sws-spline", swsScaler(decoder.get(), width, height, SWS_SPLINE)});
+  candidates.push_back(
+      {"sws-area", swsScaler(decoder.get(), width, height, SWS_AREA)});
+  if (AreaScaler::supports(decoder->width, decoder->height, decoder->pix_fmt,
+                           decoder->color_range, width, height,
+                           OutputFormat)) {
+    const auto best = AreaScaler::detectIsa();
+    for (auto isa : {AreaScaler::Isa::Scalar, AreaScaler::Isa::Sse41,
+                     AreaScaler::Isa::Avx2}) {
+      if (isa > best)
+        break;
+      candidates.push_back(
+          {QString("area-") + AreaScaler::isaName(isa),
+           areaScaler(decoder.get(), width, height, 0, isa)});
+    }
+    candidates.push_back({QString("area-") + AreaScaler::isaName(best) +
+                              "-sharpen",
+                          areaScaler(decoder.get(), width, height,
+                                     EncoderSettings().downscaleSharpen,
+                                     best)});
+  }
+  const auto reference =
+      swsScaler(decoder.get(), width, height, ReferenceFlags);
+
+  auto referenceFrame = allocateFrame(width, height);
+  auto scaledFrame = allocateFrame(width, height);
+  auto packet = AVPacketPtr(av_packet_alloc());
+  auto frame = AVFramePtr(av_frame_alloc());
+  int frames = 0;
+
+  const auto scaleDecoded = [&]() {
+    while (frames < maxFrames &&
+           avcodec_receive_frame(decoder.get(), frame.get()) >= 0) {
+      reference(frame.get(), referenceFrame.get());
+      for (auto& candidate : candidates) {
+        const auto start = std::chrono::steady_clock::now();
+        candidate.scale(frame.get(), scaledFrame.get());
+        candidate.totalNs +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+        addSquaredError(referenceFrame.get(), scaledFrame.get(),
+                        candidate.squaredError);
+      }
+      av_frame_unref(frame.get());
+      ++frames;
+    }
+  };
+
+  while (frames < maxFrames && av_read_frame(input.get(), packet.get()) >= 0) {
+    if (packet->stream_index == index &&
+        avcodec_send_packet(decoder.get(), packet.get()) >= 0) {
+      scaleDecoded();
+    }
+    av_packet_unref(packet.get());
+  }
+  avcodec_send_packet(decoder.get(), nullptr);
+  scaleDecoded();
+
+  const double lumaSamples = static_cast<double>(width) * height * frames;
+  const double chromaSamples =
+      static_cast<double>((width + 1) / 2) * ((height + 1) / 2) * frames;
+
+  QJsonArray results;
+  for (const auto& candidate : candidates) {
+    const auto& error = candidate.squaredError;
+    results.append(QJsonObject{
+        {"clip", QFileInfo(clip).fileName()},
+        {"scaler", candidate.name},
+        {"frames", frames},
+        {"msPerFrame", frames ? candidate.totalNs / 1e6 / frames : 0.0},
+        {"psnrY", psnr(error[0], lumaSamples)},
+        {"psnrU", psnr(error[1], chromaSamples)},
+        {"psnrV", psnr(error[2], chromaSamples)},
+        {"psnr", psnr(error[0] + error[1] + error[2],
+                      lumaSamples + 2 * chromaSamples)},
+    });
+  }
+
+  return results;
+}
+
+}  // namespace
+
+QJsonArray benchScalers(const std::vector<QString>& clips,
+                        int width,
+                        int height,
+                        int maxFrames) {
+  QJsonArray results;
+  for (const auto& clip : clips) {
+    try {
+      for (const auto& result : benchClip(clip, width, height, maxFrames))
+        results.append(result);
+    } catch (std::exception& ex) {
+      results.append(QJsonObject{{"clip", QFileInfo(clip).fileName()},
+                                 {"error", ex.what()}});
+    }
+  }
+
+  return results;
+}
@@ -0,0 +1,17 @@
+#ifndef SCALERBENCH_H
+#define SCALERBENCH_H
+
+#include <QJsonArray>
+#include <QString>
+#include <vector>
+
+// Decodes the first frames of every clip and downscales each of them with
+// swscale spline and area, and with AreaScaler on every instruction set
+// this CPU runs. Reports time per frame and PSNR against a swscale
+// Lanczos reference with accurate rounding.
+QJsonArray benchScalers(const std::vector<QString>& clips,
+                        int width,
+                        int height,
+                        int maxFrames);
+
+#endif  // SCALERBENCH_H
@@ -0,0 +1,248 @@
+#include "SyntheticCorpus.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <memory>
+#include <stdexcept>
+
+#include "converter/StreamingContext.h"
+extern "C" {
+#include <libavdevice/avdevice.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+constexpr auto ClipExtension = ".mkv";
+constexpr auto PartialExtension = ".part";
+constexpr auto LavfiFormat = "lavfi";
+constexpr auto ClipFormat = "matroska";
+// Bits per pixel, keeps the corpus small but far from a still image.
+constexpr auto ClipBitsPerPixel = 0.1;
+
+constexpr auto OpenSourceException = "Failed to open libavfilter source";
+constexpr auto OpenDecoderException = "Failed to open source decoder";
+constexpr auto FindEncoderException = "None of the clip encoders is available";
+constexpr auto OpenEncoderException = "Failed to open clip encoder";
+constexpr auto OpenClipException = "Failed to open clip for writing";
+constexpr auto WriteClipException = "Failed to write clip";
+constexpr auto DecodeSourceException = "Failed to decode source frame";
+constexpr auto EncodeClipException = "Failed to encode clip frame";
+
+struct InputContextDeleter {
+  void operator()(AVFormatContext* context) {
+    if (context)
+      avformat_close_input(&context);
+  }
+};
+
+struct OutputContextDeleter {
+  void operator()(AVFormatContext* context) {
+    if (context) {
+      if (!(context->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&context->pb);
+      avformat_free_context(context);
+    }
+  }
+};
+
+using InputContextPtr = std::unique_ptr<AVFormatContext, InputContextDeleter>;
+using OutputContextPtr =
+    std::unique_ptr<AVFormatContext, OutputContextDeleter>;
+
+const AVCodec* findEncoder(const QStringList& names) {
+  for (const auto& name : names) {
+    if (const auto* codec =
+            avcodec_find_encoder_by_name(name.toStdString().c_str()))
+      return codec;
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+SyntheticCorpus::SyntheticCorpus(QString directory)
+    : directory(std::move(directory)) {}
+
+std::vector<QString> SyntheticCorpus::generate(
+    const std::vector<CorpusClip>& clips) const {
+  avdevice_register_all();
+  QDir().mkpath(directory);
+
+  std::vector<QString> paths;
+  for (const auto& clip : clips) {
+    const auto path =
+        QDir(directory).absoluteFilePath(clip.name + ClipExtension);
+    if (!QFileInfo::exists(path)) {
+      // Written aside first, so an interrupted run never leaves a clip
+      // that later runs would take for complete.
+      const auto partial = path + PartialExtension;
+      writeClip(clip, partial);
+      QFile::rename(partial, path);
+    }
+    paths.push_back(path);
+  }
+
+  return paths;
+}
+
+std::vector<CorpusClip> SyntheticCorpus::defaultClips() {
+  return {
+      {"testsrc2_480p30_h264", "testsrc2", {"libx264", "mpeg4"}, 854, 480,
+       30, 30},
+      {"mandelbrot_1080p60_mpeg4", "mandelbrot", {"mpeg4"}, 1920, 1080, 60,
+       250},
+      {"testsrc2_1080p24_vp9", "testsrc2", {"libvpx-vp9", "mpeg4"}, 1920,
+       1080, 24, 120},
+      {"testsrc2_2160p30_h264", "testsrc2", {"libx264", "mpeg4"}, 3840, 2160,
+       30, 120},
+  };
+}
+
+void SyntheticCorpus::writeClip(const CorpusClip& clip,
+                                const QString& path) const {
+  const auto graph =
+      QString("%1=size=%2x%3:rate=%4,trim=duration=%5,format=yuv420p")
+          .arg(clip.source)
+          .arg(clip.width)
+          .arg(clip.height)
+          .arg(clip.fps)
+          .arg(clip.durationMs / 1000.0)
+          .toStdString();
+  const auto pathStd = path.toStdString();
+
+  AVFormatContext* inputContext = nullptr;
+  if (avformat_open_input(&inputContext, graph.c_str(),
+                          av_find_input_format(LavfiFormat), nullptr) != 0) {
+    throw std::runtime_error(OpenSourceException);
+  }
+  auto input = InputContextPtr(inputContext);
+  if (avformat_find_stream_info(input.get(), nullptr) < 0) {
+    throw std::runtime_error(OpenSourceException);
+  }
+  auto* inputStream = input->streams[0];
+
+  const auto* decoderCodec =
+      avcodec_find_decoder(inputStream->codecpar->codec_id);
+  auto decoder = AVCodecContextPtr(avcodec_alloc_context3(decoderCodec));
+  if (!decoder ||
+      avcodec_parameters_to_context(decoder.get(), inputStream->codecpar) <
+          0 ||
+      avcodec_open2(decoder.get(), decoderCodec, nullptr) < 0) {
+    throw std::runtime_error(OpenDecoderException);
+  }
+
+  const auto* encoderCodec = findEncoder(clip.codecs);
+  if (!encoderCodec) {
+    throw std::runtime_error(FindEncoderException);
+  }
+
+  auto encoder = AVCodecContextPtr(avcodec_alloc_context3(encoderCodec));
+  if (!encoder) {
+    throw std::runtime_error(OpenEncoderException);
+  }
+  encoder->width = clip.width;
+  encoder->height = clip.height;
+  encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+  encoder->time_base = {1, clip.fps};
+  encoder->framerate = {clip.fps, 1};
+  encoder->gop_size = clip.gopSize;
+  encoder->max_b_frames = encoderCodec->id == AV_CODEC_ID_VP9 ? 0 : 2;
+  encoder->bit_rate = static_cast<int64_t>(clip.width * clip.height *
+                                           clip.fps * ClipBitsPerPixel);
+  // Generation speed matters more than quality here. Each option is only
+  // understood by one of the encoders, the others ignore it.
+  av_opt_set(encoder->priv_data, "preset", "veryfast", 0);
+  av_opt_set(encoder->priv_data, "deadline", "realtime", 0);
+  av_opt_set_int(encoder->priv_data, "cpu-used", 8, 0);
+
+  AVFormatContext* outputContext = nullptr;
+  avformat_alloc_output_context2(&outputContext, nullptr, ClipFormat,
+                                 pathStd.c_str());
+  if (!outputContext) {
+    throw std::runtime_error(OpenClipException);
+  }
+  auto output = OutputContextPtr(outputContext);
+
+  if (output->oformat->flags & AVFMT_GLOBALHEADER)
+    encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  if (avcodec_open2(encoder.get(), encoderCodec, nullptr) < 0) {
+    throw std::runtime_error(OpenEncoderException);
+  }
+
+  auto* outputStream = avformat_new_stream(output.get(), nullptr);
+  if (!outputStream) {
+    throw std::runtime_error(OpenClipException);
+  }
+  avcodec_parameters_from_context(outputStream->codecpar, encoder.get());
+  outputStream->time_base = encoder->time_base;
+
+  if (avio_open(&output->pb, pathStd.c_str(), AVIO_FLAG_WRITE) < 0 ||
+      avformat_write_header(output.get(), nullptr) < 0) {
+    throw std::runtime_error(OpenClipException);
+  }
+
+  auto inputPacket = AVPacketPtr(av_packet_alloc());
+  auto outputPacket = AVPacketPtr(av_packet_alloc());
+  auto frame = AVFramePtr(av_frame_alloc());
+  int64_t frameIndex = 0;
+
+  const auto writePackets = [&encoder, &output, &outputPacket,
+                             outputStream]() {
+    for (;;) {
+      const auto response =
+          avcodec_receive_packet(encoder.get(), outputPacket.get());
+      if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+        return;
+      } else if (response < 0) {
+        throw std::runtime_error(EncodeClipException);
+      }
+
+      outputPacket->stream_index = outputStream->index;
+      av_packet_rescale_ts(outputPacket.get(), encoder->time_base,
+                           outputStream->time_base);
+      if (av_interleaved_write_frame(output.get(), outputPacket.get()) < 0) {
+        throw std::runtime_error(WriteClipException);
+      }
+    }
+  };
+
+  const auto encodeFrames = [&decoder, &encoder, &frame, &frameIndex,
+                             &writePackets]() {
+    for (;;) {
+      const auto response = avcodec_receive_frame(decoder.get(), frame.get());
+      if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+        return;
+      } else if (response < 0) {
+        throw std::runtime_error(DecodeSourceException);
+      }
+
+      frame->pts = frameIndex++;
+      frame->pict_type = AV_PICTURE_TYPE_NONE;
+      const auto sent = avcodec_send_frame(encoder.get(), frame.get());
+      av_frame_unref(frame.get());
+      if (sent < 0) {
+        throw std::runtime_error(EncodeClipException);
+      }
+      writePackets();
+    }
+  };
+
+  while (av_read_frame(input.get(), inputPacket.get()) >= 0) {
+    const auto response = avcodec_send_packet(decoder.get(), inputPacket.get());
+    av_packet_unref(inputPacket.get());
+    if (response < 0) {
+      throw std::runtime_error(DecodeSourceException);
+    }
+    encodeFrames();
+  }
+
+  avcodec_send_packet(decoder.get(), nullptr);
+  encodeFrames();
+  avcodec_send_frame(encoder.get(), nullptr);
+  writePackets();
+
+  if (av_write_trailer(output.get()) < 0) {
+    throw std::runtime_error(WriteClipException);
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef SYNTHETICCORPUS_H
+#define SYNTHETICCORPUS_H
+
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+struct CorpusClip {
+  QString name;
+  // libavfilter source, size and rate are appended from the fields below.
+  QString source;
+  // Encoders tried in order, the first one this FFmpeg build has wins.
+  QStringList codecs;
+  int width = 0;
+  int height = 0;
+  int fps = 30;
+  int gopSize = 30;
+  int durationMs = 4000;
+};
+
+// Renders libavfilter test sources into a local corpus of encoded clips,
+// so benchmark runs on different machines read the same kind of input.
+class SyntheticCorpus {
+ public:
+  explicit SyntheticCorpus(QString directory);
+
+  // Writes clips that are not on disk yet and returns all clip paths.
+  std::vector<QString> generate(const std::vector<CorpusClip>& clips) const;
+
+  static std::vector<CorpusClip> defaultClips();
+
+ private:
+  void writeClip(const CorpusClip& clip, const QString& path) const;
+
+  QString directory;
+};
+
+#endif  // SYNTHETICCORPUS_H
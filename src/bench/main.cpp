@@ -0,0 +1,250 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QUuid>
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <vector>
+
+#include "ScalerBench.h"
+#include "SyntheticCorpus.h"
+#include "converter/VideoTranscoder.h"
+#include "utility/ThreadBudget.h"
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+// windows.h must come first
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+constexpr auto Application = "tgemoji-bench";
+constexpr auto Description =
+    "Converts a synthetic corpus with every transcoder mode and writes "
+    "frames/s, per-stage time, peak RSS and output size as JSON.";
+constexpr auto DefaultCorpus = "tgemoji-bench-corpus";
+constexpr auto DefaultResults = "tgemoji-bench.json";
+constexpr auto ResultsVersion = 1;
+// Starts past the first keyframe so every run exercises the seek path.
+constexpr auto BeginPosMs = 500;
+constexpr auto EndPosMs = 3500;
+constexpr auto ScalerFrames = 60;
+
+struct BenchMode {
+  QString name;
+  EncoderSettings settings;
+};
+
+std::vector<BenchMode> benchModes() {
+  EncoderSettings sizeTargeted;
+  EncoderSettings spline;
+  spline.areaDownscale = false;
+  EncoderSettings streaming;
+  streaming.targetFileSize = false;
+  EncoderSettings pipelined;
+  pipelined.pipelined = true;
+
+  return {{"size-targeted", sizeTargeted},
+          {"size-targeted-spline", spline},
+          {"streaming", streaming},
+          {"pipelined", pipelined}};
+}
+
+// High-water mark of the whole process, so it never decreases between runs.
+qint64 peakRssKb() {
+#if defined(Q_OS_WIN)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return static_cast<qint64>(counters.PeakWorkingSetSize / 1024);
+  return -1;
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1;
+#if defined(Q_OS_MACOS)
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+double toMs(int64_t us) {
+  return us / 1000.0;
+}
+
+QJsonObject runOnce(const QString& clip,
+                    const BenchMode& mode,
+                    const QString& outputDir,
+                    int run) {
+  const auto baseName = QFileInfo(clip).completeBaseName();
+  const auto extension = QString::fromStdString(mode.settings.outputExtension);
+  const auto output =
+      QDir(outputDir).absoluteFilePath(baseName + '_' + mode.name + extension);
+
+  QJsonObject result{{"clip", QFileInfo(clip).fileName()},
+                     {"mode", mode.name},
+                     {"run", run}};
+
+  auto decoder = ContextPtr(new StreamingContext);
+  auto encoder = ContextPtr(new StreamingContext);
+  decoder->filename = clip.toStdString();
+  encoder->filename = output.toStdString();
+
+  ThreadBudget budget;
+  VideoTranscoder transcoder(std::move(encoder), std::move(decoder),
+                             mode.settings);
+  transcoder.setThreadBudget(&budget, 1);
+
+  QElapsedTimer timer;
+  timer.start();
+  try {
+    transcoder.process({QUuid::createUuid(), clip, BeginPosMs, EndPosMs});
+  } catch (std::exception& ex) {
+    result.insert("error", ex.what());
+    return result;
+  }
+  const auto wallMs = std::max<qint64>(timer.elapsed(), 1);
+
+  const auto stats = transcoder.getStats();
+  result.insert("wallMs", wallMs);
+  result.insert("decodedFrames", static_cast<qint64>(stats.decodedFrames));
+  result.insert("scaledFrames", static_cast<qint64>(stats.scaledFrames));
+  result.insert("droppedFrames", static_cast<qint64>(stats.droppedFrames));
+  result.insert("earlyAborts", static_cast<qint64>(stats.earlyAborts));
+  result.insert("framesPerSecond", stats.scaledFrames * 1000.0 / wallMs);
+  result.insert("stagesMs", QJsonObject{{"demux", toMs(stats.demuxUs)},
+                                        {"decode", toMs(stats.decodeUs)},
+                                        {"scale", toMs(stats.scaleUs)},
+                                        {"encode", toMs(stats.encodeUs)},
+                                        {"mux", toMs(stats.muxUs)}});
+  result.insert("allocations",
+                QJsonObject{
+                    {"frames", static_cast<qint64>(stats.frameAllocations)},
+                    {"buffers", static_cast<qint64>(stats.bufferAllocations)},
+                    {"packets", static_cast<qint64>(stats.packetAllocations)},
+                });
+  const auto scaledFrames = std::max<int64_t>(stats.scaledFrames, 1);
+  result.insert(
+      "copies",
+      QJsonObject{
+          {"frames", static_cast<qint64>(stats.copiedFrames)},
+          {"bytes", static_cast<qint64>(stats.copiedBytes)},
+          {"bytesPerFrame",
+           static_cast<double>(stats.copiedBytes) / scaledFrames},
+          {"allocationsPerFrame",
+           static_cast<double>(stats.frameAllocations +
+                               stats.bufferAllocations +
+                               stats.packetAllocations) /
+               scaledFrames},
+      });
+  result.insert("outputBytes", QFileInfo(output).size());
+  result.insert("peakRssKb", peakRssKb());
+
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName(Application);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(Description);
+  parser.addHelpOption();
+
+  QCommandLineOption corpusOption(
+      {"c", "corpus"}, "Corpus directory, generated when missing.", "dir",
+      QDir(QDir::tempPath()).absoluteFilePath(DefaultCorpus));
+  QCommandLineOption resultsOption({"o", "output"},
+                                   "JSON results file, - for stdout.", "file",
+                                   DefaultResults);
+  QCommandLineOption runsOption({"r", "runs"}, "Runs per clip and mode.",
+                                "count", "1");
+  QCommandLineOption modeOption({"m", "mode"},
+                                "Only run the named mode, can repeat.", "name");
+  QCommandLineOption scalersOption(
+      {"s", "scalers"},
+      "Also compare downscalers for speed and PSNR on the first frames.");
+  parser.addOptions(
+      {corpusOption, resultsOption, runsOption, modeOption, scalersOption});
+  parser.process(app);
+
+  const auto corpusDir = parser.value(corpusOption);
+  std::vector<QString> clips;
+  try {
+    const SyntheticCorpus corpus(corpusDir);
+    clips = corpus.generate(SyntheticCorpus::defaultClips());
+  } catch (std::exception& ex) {
+    std::fprintf(stderr, "Failed to generate corpus: %s\n", ex.what());
+    return 2;
+  }
+
+  const auto outputDir = QDir(corpusDir).absoluteFilePath("out");
+  QDir().mkpath(outputDir);
+
+  const auto selectedModes = parser.values(modeOption);
+  const auto runs = std::max(parser.value(runsOption).toInt(), 1);
+
+  QJsonArray results;
+  for (const auto& mode : benchModes()) {
+    if (!selectedModes.isEmpty() && !selectedModes.contains(mode.name))
+      continue;
+
+    for (const auto& clip : clips) {
+      for (int run = 0; run < runs; ++run) {
+        const auto result = runOnce(clip, mode, outputDir, run);
+        std::fprintf(stderr, "%s %s run %d: %.1f frames/s\n",
+                     qPrintable(mode.name),
+                     qPrintable(QFileInfo(clip).fileName()), run,
+                     result.value("framesPerSecond").toDouble());
+        results.append(result);
+      }
+    }
+  }
+
+  QJsonObject document{
+      {"version", ResultsVersion},
+      {"date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+      {"ffmpeg", av_version_info()},
+      {"cpuThreads", ThreadBudget::defaultTotal()},
+      {"beginMs", BeginPosMs},
+      {"endMs", EndPosMs},
+      {"results", results},
+  };
+  if (parser.isSet(scalersOption)) {
+    const EncoderSettings settings;
+    document.insert("scalers", benchScalers(clips, settings.width,
+                                            settings.height, ScalerFrames));
+  }
+  const auto json = QJsonDocument(document).toJson(QJsonDocument::Indented);
+
+  const auto resultsPath = parser.value(resultsOption);
+  if (resultsPath == "-") {
+    std::fwrite(json.constData(), 1, json.size(), stdout);
+    return 0;
+  }
+
+  QFile file(resultsPath);
+  if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+    std::fprintf(stderr, "Failed to write %s\n", qPrintable(resultsPath));
+    return 2;
+  }
+  file.write(json);
+
+  return 0;
+}
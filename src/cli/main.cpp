@@ -0,0 +1,319 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QUuid>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "converter/OutputProfiles.h"
+#include "converter/ToWebmConvertor.h"
+#include "utility/FFmpegUtility.h"
+
+namespace {
+constexpr auto Application = "tgemoji-cli";
+constexpr auto Description =
+    "Converts video clips to Telegram emoji webm files.\n"
+    "Prints one JSON object per job and a summary object at the end.";
+constexpr auto DefaultEndPos = 3000;
+constexpr auto ManifestSeparator = '\t';
+constexpr auto ManifestComment = '#';
+constexpr auto ProbeFailedError = "Failed to read video duration";
+constexpr auto ManifestLineError = "Malformed manifest line";
+
+struct Batch {
+  std::vector<VideoProp> props;
+  QHash<QUuid, VideoProp> jobs;
+  // Per profile results of jobs converted with output profiles.
+  QHash<QUuid, QJsonArray> outputs;
+  int failed = 0;
+  int succeeded = 0;
+  qint64 outputBytes = 0;
+  qint64 inputMs = 0;
+};
+
+void printJson(const QJsonObject& object) {
+  std::fputs(QJsonDocument(object).toJson(QJsonDocument::Compact).constData(),
+             stdout);
+  std::fputc('\n', stdout);
+  std::fflush(stdout);
+}
+
+QJsonObject jobResult(const VideoProp& prop) {
+  return {{"id", prop.uuid.toString(QUuid::StringFormat::WithoutBraces)},
+          {"input", prop.path},
+          {"beginMs", static_cast<qint64>(prop.beginPosMs)},
+          {"endMs", static_cast<qint64>(prop.endPosMs)}};
+}
+
+void reportFailure(Batch& batch, const VideoProp& prop, const QString& error) {
+  auto result = jobResult(prop);
+  result.insert("status", "failed");
+  result.insert("error", error);
+  printJson(result);
+  ++batch.failed;
+}
+
+// Queues a clip, an end position of zero means the default clip length.
+void addJob(Batch& batch,
+            const QString& path,
+            int64_t begin,
+            int64_t end,
+            int priority = 0) {
+  VideoProp prop{QUuid::createUuid(), path, begin, end, priority};
+
+  const auto duration = getVideoDurationMs(path);
+  if (duration <= 0) {
+    reportFailure(batch, prop, ProbeFailedError);
+    return;
+  }
+
+  if (prop.endPosMs <= 0)
+    prop.endPosMs = prop.beginPosMs + DefaultEndPos;
+  prop.endPosMs = std::min(prop.endPosMs, duration);
+
+  batch.jobs.insert(prop.uuid, prop);
+  batch.props.push_back(std::move(prop));
+}
+
+// Each manifest line is "path<TAB>beginMs<TAB>endMs<TAB>priority", all but
+// the path are optional. Relative paths are resolved against the manifest
+// directory, higher priorities start first.
+bool readManifest(Batch& batch, const QString& fileName) {
+  QFile file(fileName);
+  if (!file.open(QFile::ReadOnly | QFile::Text)) {
+    std::fprintf(stderr, "Failed to open manifest %s\n",
+                 qPrintable(fileName));
+    return false;
+  }
+
+  const auto baseDir = QFileInfo(fileName).absoluteDir();
+  QTextStream stream(&file);
+  while (!stream.atEnd()) {
+    const auto line = stream.readLine().trimmed();
+    if (line.isEmpty() || line.startsWith(ManifestComment))
+      continue;
+
+    const auto fields = line.split(ManifestSeparator);
+    const auto path = baseDir.absoluteFilePath(fields[0]);
+    bool beginOk = true;
+    bool endOk = true;
+    bool priorityOk = true;
+    const int64_t begin =
+        fields.size() > 1 ? fields[1].toLongLong(&beginOk) : 0;
+    const int64_t end = fields.size() > 2 ? fields[2].toLongLong(&endOk) : 0;
+    const int priority = fields.size() > 3 ? fields[3].toInt(&priorityOk) : 0;
+
+    if (!beginOk || !endOk || !priorityOk || fields.size() > 4) {
+      reportFailure(batch, {QUuid::createUuid(), path, begin, end},
+                    ManifestLineError);
+      continue;
+    }
+
+    addJob(batch, path, begin, end, priority);
+  }
+
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName(Application);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(Description);
+  parser.addHelpOption();
+  parser.addPositionalArgument("files", "Video files to convert.",
+                               "[files...]");
+
+  QCommandLineOption outputOption({"o", "output"}, "Output directory.", "dir",
+                                  QDir::currentPath());
+  QCommandLineOption manifestOption(
+      {"m", "manifest"}, "Tab separated path/begin/end list.", "file");
+  QCommandLineOption jobsOption({"j", "jobs"}, "Concurrent conversions.",
+                                "count");
+  QCommandLineOption beginOption({"b", "begin"},
+                                 "Begin position in ms for listed files.",
+                                 "ms", "0");
+  QCommandLineOption endOption(
+      {"e", "end"}, "End position in ms for listed files.", "ms", "0");
+  QCommandLineOption threadsOption(
+      {"t", "threads"}, "Codec threads shared by all jobs.", "count");
+  QCommandLineOption pipelineOption(
+      "pipeline", "Decode, scale and encode each clip on separate threads.");
+  QCommandLineOption noCacheOption(
+      "no-cache", "Always encode, never reuse a cached output.");
+  QCommandLineOption traceOption(
+      "trace", "Write a Chrome trace of the batch into the directory.", "dir");
+  QCommandLineOption fifoOption(
+      "fifo", "Start jobs in input order, not shortest first.");
+  QCommandLineOption journalOption(
+      "journal", "Record job states in the file to resume after a crash.",
+      "file");
+  QCommandLineOption resumeOption(
+      "resume", "Also run the jobs the journal left unfinished.");
+  QCommandLineOption maxFpsOption(
+      "max-fps", "Output frame rate cap, 0 keeps the source rate.", "fps");
+  QCommandLineOption noSharedDecodeOption(
+      "no-shared-decode",
+      "Decode every clip on its own, even when several cut the same file.");
+  QCommandLineOption profileOption(
+      "profile",
+      "Comma separated output profiles, each clip is encoded into all of "
+      "them from one decode. Known: " +
+          OutputProfiles::shared().names().join(", ") + '.',
+      "names");
+  parser.addOptions({outputOption, manifestOption, jobsOption, threadsOption,
+                     beginOption, endOption, pipelineOption, noCacheOption,
+                     maxFpsOption, traceOption, fifoOption, journalOption,
+                     resumeOption, profileOption, noSharedDecodeOption});
+  parser.process(app);
+
+  Batch batch;
+  const auto begin = parser.value(beginOption).toLongLong();
+  const auto end = parser.value(endOption).toLongLong();
+  for (const auto& file : parser.positionalArguments()) {
+    addJob(batch, QFileInfo(file).absoluteFilePath(), begin, end);
+  }
+
+  if (parser.isSet(manifestOption) &&
+      !readManifest(batch, parser.value(manifestOption))) {
+    return 2;
+  }
+
+  const auto resume = parser.isSet(resumeOption);
+  if (resume && !parser.isSet(journalOption)) {
+    std::fputs("--resume needs --journal\n", stderr);
+    return 2;
+  }
+  if (batch.props.empty() && batch.failed == 0 && !resume) {
+    parser.showHelp(2);
+  }
+
+  const auto outputDir = QDir(parser.value(outputOption)).absolutePath();
+  QDir().mkpath(outputDir);
+
+  ToWebmConvertor convertor;
+  if (parser.isSet(jobsOption))
+    convertor.setMaxConcurrency(parser.value(jobsOption).toInt());
+  if (parser.isSet(threadsOption))
+    convertor.setThreadBudget(parser.value(threadsOption).toInt());
+  if (parser.isSet(noCacheOption))
+    convertor.setOutputCacheSize(0);
+  if (parser.isSet(noSharedDecodeOption))
+    convertor.setSharedDecode(false);
+  if (parser.isSet(fifoOption))
+    convertor.setSchedulingPolicy(ToWebmConvertor::SchedulingPolicy::Fifo);
+  if (parser.isSet(traceOption))
+    convertor.setTraceDirectory(
+        QDir(parser.value(traceOption)).absolutePath());
+  if (parser.isSet(journalOption))
+    convertor.setJournalFile(
+        QFileInfo(parser.value(journalOption)).absoluteFilePath());
+  if (parser.isSet(profileOption)) {
+    const auto profiles = parser.value(profileOption).split(',');
+    for (const auto& profile : profiles) {
+      if (!OutputProfiles::shared().find(profile)) {
+        std::fprintf(stderr, "Unknown output profile %s\n",
+                     qPrintable(profile));
+        return 2;
+      }
+    }
+    convertor.setOutputProfiles(profiles);
+  }
+
+  auto settings = convertor.getEncoderSettings();
+  settings.pipelined = parser.isSet(pipelineOption);
+  if (parser.isSet(maxFpsOption))
+    settings.maxOutputFps = parser.value(maxFpsOption).toInt();
+  convertor.setEncoderSettings(std::move(settings));
+
+  auto remaining = batch.props.size();
+  QElapsedTimer timer;
+  timer.start();
+
+  QObject::connect(
+      &convertor, &ToWebmConvertor::outputFinished, &app,
+      [&batch](QUuid uuid, QString profile, QString outputPath,
+               QString error) {
+        QJsonObject output{{"profile", profile}};
+        if (error.isEmpty()) {
+          output.insert("output", outputPath);
+          output.insert("bytes", QFileInfo(outputPath).size());
+        } else {
+          output.insert("error", error);
+        }
+        batch.outputs[uuid].append(output);
+      });
+
+  QObject::connect(
+      &convertor, &ToWebmConvertor::finished, &app,
+      [&batch, &remaining, &timer](QUuid uuid, QString outputPath,
+                                   QString error) {
+        const auto& prop = batch.jobs[uuid];
+        if (!error.isEmpty()) {
+          batch.outputs.remove(uuid);
+          reportFailure(batch, prop, error);
+        } else {
+          const auto bytes = QFileInfo(outputPath).size();
+          auto result = jobResult(prop);
+          result.insert("status", "ok");
+          result.insert("output", outputPath);
+          result.insert("bytes", bytes);
+          result.insert("elapsedMs", timer.elapsed());
+          if (batch.outputs.contains(uuid))
+            result.insert("outputs", batch.outputs.take(uuid));
+          printJson(result);
+
+          ++batch.succeeded;
+          batch.outputBytes += bytes;
+          batch.inputMs += prop.endPosMs - prop.beginPosMs;
+        }
+
+        if (--remaining == 0)
+          QCoreApplication::quit();
+      });
+
+  // Resumed jobs keep the output directory they were first pushed to.
+  if (resume) {
+    for (const auto& prop : convertor.abandoned()) {
+      std::fprintf(stderr, "Gave up on %s after repeated crashes\n",
+                   qPrintable(prop.path));
+    }
+    for (auto& prop : convertor.resume()) {
+      batch.jobs.insert(prop.uuid, prop);
+      ++remaining;
+    }
+  }
+
+  if (!batch.props.empty())
+    convertor.push(outputDir, batch.props);
+  if (remaining > 0)
+    app.exec();
+
+  const auto elapsedMs = std::max<qint64>(timer.elapsed(), 1);
+  printJson({{"summary",
+              QJsonObject{
+                  {"jobs", batch.succeeded + batch.failed},
+                  {"succeeded", batch.succeeded},
+                  {"failed", batch.failed},
+                  {"threads", convertor.getMaxConcurrency()},
+                  {"elapsedMs", elapsedMs},
+                  {"jobsPerSecond", batch.succeeded * 1000.0 / elapsedMs},
+                  {"clipSecondsPerSecond",
+                   static_cast<double>(batch.inputMs) / elapsedMs},
+                  {"outputBytes", batch.outputBytes},
+              }}});
+
+  return batch.failed > 0 ? 1 : 0;
+}
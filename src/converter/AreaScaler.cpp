@@ -0,0 +1,307 @@
+#include "AreaScaler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define AREASCALER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// Functions built for an instruction set the compiler is not told to use
+// everywhere, they are only called after detectIsa. MSVC needs no flag.
+#if defined(__GNUC__) || defined(__clang__)
+#define AREASCALER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define AREASCALER_TARGET(isa)
+#endif
+
+namespace {
+// Weights are in 1/256 of a source line, so a weighted 8-bit sample still
+// fits 16 bits: 255 * 256 < 65536.
+constexpr auto WeightOne = 256;
+
+void accumulateRowScalar(const uint8_t* src,
+                         int count,
+                         uint32_t weight,
+                         uint32_t* accumulators) {
+  for (int i = 0; i < count; ++i)
+    accumulators[i] += src[i] * weight;
+}
+
+#if defined(AREASCALER_X86)
+AREASCALER_TARGET("sse4.1")
+void accumulateRowSse41(const uint8_t* src,
+                        int count,
+                        uint32_t weight,
+                        uint32_t* accumulators) {
+  const auto weights = _mm_set1_epi16(static_cast<short>(weight));
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto samples = _mm_cvtepu8_epi16(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+    const auto products = _mm_mullo_epi16(samples, weights);
+
+    auto* out = reinterpret_cast<__m128i*>(accumulators + i);
+    _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out),
+                                        _mm_cvtepu16_epi32(products)));
+    const auto high = _mm_srli_si128(products, 8);
+    _mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1),
+                                            _mm_cvtepu16_epi32(high)));
+  }
+  accumulateRowScalar(src + i, count - i, weight, accumulators + i);
+}
+
+AREASCALER_TARGET("avx2")
+void accumulateRowAvx2(const uint8_t* src,
+                       int count,
+                       uint32_t weight,
+                       uint32_t* accumulators) {
+  const auto weights = _mm256_set1_epi16(static_cast<short>(weight));
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const auto samples = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+    const auto products = _mm256_mullo_epi16(samples, weights);
+
+    auto* out = reinterpret_cast<__m256i*>(accumulators + i);
+    _mm256_storeu_si256(
+        out, _mm256_add_epi32(
+                 _mm256_loadu_si256(out),
+                 _mm256_cvtepu16_epi32(_mm256_castsi256_si128(products))));
+    _mm256_storeu_si256(
+        out + 1,
+        _mm256_add_epi32(
+            _mm256_loadu_si256(out + 1),
+            _mm256_cvtepu16_epi32(_mm256_extracti128_si256(products, 1))));
+  }
+  accumulateRowScalar(src + i, count - i, weight, accumulators + i);
+}
+
+bool cpuHasSse41() {
+#if defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 1);
+  return (info[2] & (1 << 19)) != 0;
+#else
+  return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+bool cpuHasAvx2() {
+#if defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 1);
+  const auto osSavesAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+                          (_xgetbv(0) & 0x6) == 0x6;
+  if (!osSavesAvx)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+uint8_t clampPixel(int value) {
+  return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+}  // namespace
+
+bool AreaScaler::supports(int srcWidth,
+                          int srcHeight,
+                          AVPixelFormat srcFormat,
+                          AVColorRange srcRange,
+                          int dstWidth,
+                          int dstHeight,
+                          AVPixelFormat dstFormat) {
+  // Full range sources need a range conversion swscale does for them.
+  return (srcFormat == AV_PIX_FMT_YUV420P || srcFormat == AV_PIX_FMT_NV12) &&
+         srcRange != AVCOL_RANGE_JPEG && dstFormat == AV_PIX_FMT_YUV420P &&
+         dstWidth > 0 && dstHeight > 0 &&
+         srcWidth >= dstWidth * MinReduction &&
+         srcHeight >= dstHeight * MinReduction;
+}
+
+AreaScaler::Isa AreaScaler::detectIsa() {
+#if defined(AREASCALER_X86)
+  if (cpuHasAvx2())
+    return Isa::Avx2;
+  if (cpuHasSse41())
+    return Isa::Sse41;
+#endif
+  return Isa::Scalar;
+}
+
+const char* AreaScaler::isaName(Isa isa) {
+  switch (isa) {
+    case Isa::Avx2:
+      return "avx2";
+    case Isa::Sse41:
+      return "sse4.1";
+    case Isa::Scalar:
+      break;
+  }
+  return "scalar";
+}
+
+AreaScaler::AreaScaler(int srcWidth,
+                       int srcHeight,
+                       AVPixelFormat srcFormat,
+                       int dstWidth,
+                       int dstHeight,
+                       double sharpen,
+                       Isa isa)
+    : srcWidth(srcWidth),
+      srcHeight(srcHeight),
+      srcFormat(srcFormat),
+      dstWidth(dstWidth),
+      dstHeight(dstHeight),
+      sharpen(static_cast<int>(std::lround(sharpen * WeightOne))),
+      isa(std::min(isa, detectIsa())) {
+  switch (this->isa) {
+#if defined(AREASCALER_X86)
+    case Isa::Avx2:
+      accumulateRow = accumulateRowAvx2;
+      break;
+    case Isa::Sse41:
+      accumulateRow = accumulateRowSse41;
+      break;
+#endif
+    default:
+      accumulateRow = accumulateRowScalar;
+      break;
+  }
+
+  const auto srcChromaWidth = (srcWidth + 1) / 2;
+  const auto srcChromaHeight = (srcHeight + 1) / 2;
+  const auto dstChromaWidth = (dstWidth + 1) / 2;
+  const auto dstChromaHeight = (dstHeight + 1) / 2;
+  lumaRows = spans(srcHeight, dstHeight);
+  lumaColumns = spans(srcWidth, dstWidth);
+  chromaRows = spans(srcChromaHeight, dstChromaHeight);
+  chromaColumns = spans(srcChromaWidth, dstChromaWidth);
+
+  // NV12 chroma rows hold both planes, interleaved.
+  accumulators.resize(std::max(srcWidth, srcChromaWidth * 2));
+  scratch.resize(static_cast<size_t>(dstWidth) * dstHeight);
+}
+
+void AreaScaler::scale(const AVFrame* src, AVFrame* dst) {
+  scalePlane(src->data[0], src->linesize[0], lumaRows, lumaColumns, 1,
+             dst->data[0], nullptr, dst->linesize[0]);
+
+  if (srcFormat == AV_PIX_FMT_NV12) {
+    scalePlane(src->data[1], src->linesize[1], chromaRows, chromaColumns, 2,
+               dst->data[1], dst->data[2], dst->linesize[1]);
+  } else {
+    scalePlane(src->data[1], src->linesize[1], chromaRows, chromaColumns, 1,
+               dst->data[1], nullptr, dst->linesize[1]);
+    scalePlane(src->data[2], src->linesize[2], chromaRows, chromaColumns, 1,
+               dst->data[2], nullptr, dst->linesize[2]);
+  }
+
+  // Chroma is left soft, the eye barely resolves it at this size.
+  if (sharpen > 0)
+    sharpenPlane(dst->data[0], dst->linesize[0], dstWidth, dstHeight);
+}
+
+AreaScaler::Isa AreaScaler::getIsa() const noexcept {
+  return isa;
+}
+
+std::vector<AreaScaler::Span> AreaScaler::spans(int srcSize, int dstSize) {
+  // Output line d covers [bound(d), bound(d + 1)) in 1/256 source lines.
+  const auto bound = [srcSize, dstSize](int d) {
+    return static_cast<int64_t>(d) * srcSize * WeightOne / dstSize;
+  };
+
+  std::vector<Span> result(dstSize);
+  for (int d = 0; d < dstSize; ++d) {
+    const auto begin = bound(d);
+    const auto end = bound(d + 1);
+    auto& span = result[d];
+    span.first = static_cast<int>(begin / WeightOne);
+    span.total = static_cast<uint64_t>(end - begin);
+
+    for (auto line = begin / WeightOne; line * WeightOne < end; ++line) {
+      const auto lineBegin = std::max(line * WeightOne, begin);
+      const auto lineEnd = std::min((line + 1) * WeightOne, end);
+      span.weights.push_back(static_cast<uint32_t>(lineEnd - lineBegin));
+    }
+  }
+
+  return result;
+}
+
+void AreaScaler::scalePlane(const uint8_t* src,
+                            int srcStride,
+                            const std::vector<Span>& rows,
+                            const std::vector<Span>& columns,
+                            int interleave,
+                            uint8_t* dst0,
+                            uint8_t* dst1,
+                            int dstStride) {
+  const auto rowLength =
+      (columns.back().first + static_cast<int>(columns.back().weights.size())) *
+      interleave;
+
+  for (size_t y = 0; y < rows.size(); ++y) {
+    const auto& row = rows[y];
+    std::fill_n(accumulators.begin(), rowLength, 0u);
+    for (size_t i = 0; i < row.weights.size(); ++i) {
+      accumulateRow(src + static_cast<ptrdiff_t>(row.first + i) * srcStride,
+                    rowLength, row.weights[i], accumulators.data());
+    }
+
+    uint8_t* outputs[] = {dst0 + y * dstStride,
+                          dst1 ? dst1 + y * dstStride : nullptr};
+    for (size_t x = 0; x < columns.size(); ++x) {
+      const auto& column = columns[x];
+      const auto total = row.total * column.total;
+      for (int channel = 0; channel < interleave; ++channel) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < column.weights.size(); ++i) {
+          sum += static_cast<uint64_t>(
+                     accumulators[(column.first + i) * interleave + channel]) *
+                 column.weights[i];
+        }
+        outputs[channel][x] = static_cast<uint8_t>((sum + total / 2) / total);
+      }
+    }
+  }
+}
+
+// Unsharp mask against a 3x3 box blur, edges repeat the border pixels.
+void AreaScaler::sharpenPlane(uint8_t* plane,
+                              int stride,
+                              int width,
+                              int height) {
+  for (int y = 0; y < height; ++y)
+    std::copy_n(plane + y * stride, width, scratch.data() + y * width);
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      int blur = 0;
+      for (int dy = -1; dy <= 1; ++dy) {
+        const auto* line =
+            scratch.data() + std::clamp(y + dy, 0, height - 1) * width;
+        for (int dx = -1; dx <= 1; ++dx)
+          blur += line[std::clamp(x + dx, 0, width - 1)];
+      }
+
+      const int pixel = scratch[y * width + x];
+      const auto detail = (pixel * 9 - blur) * sharpen;
+      const auto rounding =
+          detail >= 0 ? WeightOne * 9 / 2 : -WeightOne * 9 / 2;
+      plane[y * stride + x] =
+          clampPixel(pixel + (detail + rounding) / (WeightOne * 9));
+    }
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef AREASCALER_H
+#define AREASCALER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "StreamingContext.h"
+
+// Area (box) downscaler from YUV420P or NV12 to YUV420P for large
+// reduction ratios, where every output pixel averages the source pixels it
+// covers, partially covered ones by their coverage. Source rows are summed
+// into column accumulators with SIMD, the row then shrinks horizontally at
+// output height only. An optional unsharp pass restores edge contrast the
+// box filter softens. Far cheaper than a swscale spline at 1080p and up.
+class AreaScaler {
+ public:
+  enum class Isa { Scalar, Sse41, Avx2 };
+
+  // Limited range sources only, and at least MinReduction in each axis.
+  static bool supports(int srcWidth,
+                       int srcHeight,
+                       AVPixelFormat srcFormat,
+                       AVColorRange srcRange,
+                       int dstWidth,
+                       int dstHeight,
+                       AVPixelFormat dstFormat);
+  // Best instruction set this CPU runs.
+  static Isa detectIsa();
+  static const char* isaName(Isa isa);
+
+  AreaScaler(int srcWidth,
+             int srcHeight,
+             AVPixelFormat srcFormat,
+             int dstWidth,
+             int dstHeight,
+             double sharpen = 0,
+             Isa isa = detectIsa());
+
+  // dst must be a writable YUV420P frame of the output size.
+  void scale(const AVFrame* src, AVFrame* dst);
+
+  Isa getIsa() const noexcept;
+
+  static constexpr int MinReduction = 2;
+
+ private:
+  // Coverage of source lines by one output line, in 1/256 of a line.
+  struct Span {
+    int first = 0;
+    std::vector<uint32_t> weights;
+    uint64_t total = 0;
+  };
+
+  static std::vector<Span> spans(int srcSize, int dstSize);
+
+  // Scales one plane, interleave 2 splits NV12 chroma into dst0 and dst1.
+  void scalePlane(const uint8_t* src,
+                  int srcStride,
+                  const std::vector<Span>& rows,
+                  const std::vector<Span>& columns,
+                  int interleave,
+                  uint8_t* dst0,
+                  uint8_t* dst1,
+                  int dstStride);
+  void sharpenPlane(uint8_t* plane, int stride, int width, int height);
+
+  using AccumulateRow = void (*)(const uint8_t* src,
+                                 int count,
+                                 uint32_t weight,
+                                 uint32_t* accumulators);
+
+  int srcWidth = 0;
+  int srcHeight = 0;
+  AVPixelFormat srcFormat = AV_PIX_FMT_NONE;
+  int dstWidth = 0;
+  int dstHeight = 0;
+  int sharpen = 0;
+  Isa isa = Isa::Scalar;
+  AccumulateRow accumulateRow = nullptr;
+  std::vector<Span> lumaRows;
+  std::vector<Span> lumaColumns;
+  std::vector<Span> chromaRows;
+  std::vector<Span> chromaColumns;
+  std::vector<uint32_t> accumulators;
+  std::vector<uint8_t> scratch;
+};
+
+#endif  // AREASCALER_H
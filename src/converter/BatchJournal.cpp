@@ -0,0 +1,216 @@
+#include "BatchJournal.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace {
+constexpr auto QueuedState = "queued";
+constexpr auto RunningState = "running";
+constexpr auto InterruptedState = "interrupted";
+constexpr auto DoneState = "done";
+constexpr auto FailedState = "failed";
+constexpr auto NotResumedError = "not resumed";
+
+int64_t toInt64(const QJsonValue& value) {
+  return static_cast<int64_t>(value.toDouble());
+}
+
+QString idOf(QUuid uuid) {
+  return uuid.toString(QUuid::StringFormat::WithoutBraces);
+}
+
+QByteArray toLine(const QJsonObject& object) {
+  return QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+}
+
+QByteArray queuedLine(const VideoProp& prop,
+                      const QString& outputDir,
+                      int attempts = 0) {
+  return toLine({{"id", idOf(prop.uuid)},
+                 {"state", QueuedState},
+                 {"path", prop.path},
+                 {"begin", static_cast<qint64>(prop.beginPosMs)},
+                 {"end", static_cast<qint64>(prop.endPosMs)},
+                 {"priority", prop.priority},
+                 {"outputDir", outputDir},
+                 {"attempts", attempts}});
+}
+
+}  // namespace
+
+BatchJournal::BatchJournal(QString fileName) : file(std::move(fileName)) {
+  load();
+  if (!file.open(QFile::WriteOnly | QFile::Append))
+    qDebug() << "failed to open batch journal" << file.fileName();
+  writer = std::thread(&BatchJournal::run, this);
+}
+
+BatchJournal::~BatchJournal() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  writer.join();
+}
+
+const std::vector<JournalJob>& BatchJournal::unfinished() const noexcept {
+  return recovered;
+}
+
+const std::vector<JournalJob>& BatchJournal::abandoned() const noexcept {
+  return givenUp;
+}
+
+void BatchJournal::discardUnfinished() {
+  for (const auto& job : recovered)
+    failed(job.prop.uuid, NotResumedError);
+  recovered.clear();
+}
+
+void BatchJournal::queued(const VideoProp& prop, const QString& outputDir) {
+  append(queuedLine(prop, outputDir));
+}
+
+void BatchJournal::running(QUuid uuid) {
+  append(toLine({{"id", idOf(uuid)}, {"state", RunningState}}));
+}
+
+void BatchJournal::interrupted(QUuid uuid) {
+  append(toLine({{"id", idOf(uuid)}, {"state", InterruptedState}}));
+}
+
+void BatchJournal::done(QUuid uuid, const QString& outputPath) {
+  append(toLine(
+      {{"id", idOf(uuid)}, {"state", DoneState}, {"output", outputPath}}));
+}
+
+void BatchJournal::failed(QUuid uuid, const QString& error) {
+  append(
+      toLine({{"id", idOf(uuid)}, {"state", FailedState}, {"error", error}}));
+}
+
+void BatchJournal::flush() {
+  std::unique_lock lock(mutex);
+  const auto target = appended;
+  flushRequested = true;
+  wake.notify_one();
+  written.wait(lock, [this, target] { return flushed >= target; });
+}
+
+void BatchJournal::load() {
+  QFile previous(file.fileName());
+  if (!previous.open(QFile::ReadOnly))
+    return;
+
+  // Last state per job, a job that is queued again after it finished
+  // starts over. Attempts carried over by an earlier compaction come with
+  // its queued record, resume queues the job again and keeps them.
+  std::vector<std::pair<JournalJob, bool>> jobs;
+  QHash<QString, size_t> byId;
+  while (!previous.atEnd()) {
+    // The last line is torn when the process died while writing it.
+    const auto document = QJsonDocument::fromJson(previous.readLine());
+    if (!document.isObject())
+      continue;
+
+    const auto object = document.object();
+    const auto id = object.value("id").toString();
+    const auto state = object.value("state").toString();
+    if (state == QueuedState) {
+      JournalJob job;
+      job.prop.uuid = QUuid(id);
+      job.prop.path = object.value("path").toString();
+      job.prop.beginPosMs = toInt64(object.value("begin"));
+      job.prop.endPosMs = toInt64(object.value("end"));
+      job.prop.priority = object.value("priority").toInt();
+      job.outputDir = object.value("outputDir").toString();
+      job.attempts = object.value("attempts").toInt();
+
+      const auto found = byId.constFind(id);
+      if (found != byId.constEnd()) {
+        const auto& [earlier, finished] = jobs[*found];
+        if (!finished)
+          job.attempts = std::max(job.attempts, earlier.attempts);
+        jobs[*found] = {std::move(job), false};
+      } else {
+        byId.insert(id, jobs.size());
+        jobs.emplace_back(std::move(job), false);
+      }
+    } else if (byId.contains(id)) {
+      auto& [job, finished] = jobs[byId.value(id)];
+      if (state == RunningState)
+        ++job.attempts;
+      else if (state == InterruptedState)
+        job.attempts = std::max(job.attempts - 1, 0);
+      finished = state == DoneState || state == FailedState;
+    }
+  }
+  previous.close();
+
+  for (auto& [job, finished] : jobs) {
+    if (finished)
+      continue;
+    if (job.attempts >= MaxAttempts) {
+      qDebug() << "giving up on" << job.prop.path << "after" << job.attempts
+               << "attempts";
+      givenUp.push_back(std::move(job));
+    } else {
+      recovered.push_back(std::move(job));
+    }
+  }
+
+  // Finished jobs are never read again, only the unfinished ones are kept.
+  QSaveFile compacted(file.fileName());
+  if (!compacted.open(QFile::WriteOnly)) {
+    qDebug() << "failed to compact batch journal" << file.fileName();
+    return;
+  }
+  for (const auto& job : recovered)
+    compacted.write(queuedLine(job.prop, job.outputDir, job.attempts));
+  compacted.commit();
+}
+
+void BatchJournal::append(QByteArray line) {
+  std::lock_guard lock(mutex);
+  pending.push_back(std::move(line));
+  ++appended;
+}
+
+void BatchJournal::run() {
+  std::unique_lock lock(mutex);
+  for (;;) {
+    wake.wait_for(lock, std::chrono::milliseconds(FlushIntervalMs),
+                  [this] { return stopping || flushRequested; });
+    flushRequested = false;
+
+    const auto lines = std::move(pending);
+    pending.clear();
+    const auto target = appended;
+    const auto stop = stopping;
+
+    lock.unlock();
+    write(lines);
+    lock.lock();
+
+    flushed = target;
+    written.notify_all();
+    if (stop)
+      return;
+  }
+}
+
+void BatchJournal::write(const std::vector<QByteArray>& lines) {
+  if (lines.empty() || !file.isOpen())
+    return;
+
+  for (const auto& line : lines)
+    file.write(line);
+  file.flush();
+}
@@ -0,0 +1,78 @@
+#ifndef BATCHJOURNAL_H
+#define BATCHJOURNAL_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QUuid>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ToWebmConvertor.h"
+
+struct JournalJob {
+  VideoProp prop;
+  QString outputDir;
+  // Runs that started and never ended, the process died during each.
+  int attempts = 0;
+};
+
+// Append-only log of job states, one JSON object per line, so a batch
+// survives the process dying halfway. Records are queued in memory and
+// written by a background thread every FlushIntervalMs, callers never
+// wait on the disk. On open the log of the previous session is read back
+// and compacted to the jobs it left queued or running. A job the process
+// died running MaxAttempts times is given up, so one file that crashes the
+// converter does not crash every session after it.
+class BatchJournal {
+ public:
+  explicit BatchJournal(QString fileName);
+  ~BatchJournal();
+
+  BatchJournal(const BatchJournal&) = delete;
+  BatchJournal& operator=(const BatchJournal&) = delete;
+
+  // Jobs the previous session queued but never finished, in queue order.
+  const std::vector<JournalJob>& unfinished() const noexcept;
+  // Unfinished jobs given up after MaxAttempts, dropped from the log.
+  const std::vector<JournalJob>& abandoned() const noexcept;
+  // Records the unfinished jobs as failed, they are not offered again.
+  void discardUnfinished();
+
+  void queued(const VideoProp& prop, const QString& outputDir);
+  void running(QUuid uuid);
+  // A run stopped by shutting down, it does not count as an attempt.
+  void interrupted(QUuid uuid);
+  void done(QUuid uuid, const QString& outputPath);
+  void failed(QUuid uuid, const QString& error);
+
+  // Blocks until everything recorded so far is written.
+  void flush();
+
+  static constexpr int FlushIntervalMs = 200;
+  static constexpr int MaxAttempts = 3;
+
+ private:
+  void load();
+  void append(QByteArray line);
+  void run();
+  void write(const std::vector<QByteArray>& lines);
+
+  QFile file;
+  std::vector<JournalJob> recovered;
+  std::vector<JournalJob> givenUp;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable written;
+  std::vector<QByteArray> pending;
+  uint64_t appended = 0;
+  uint64_t flushed = 0;
+  bool flushRequested = false;
+  bool stopping = false;
+  std::thread writer;
+};
+
+#endif  // BATCHJOURNAL_H
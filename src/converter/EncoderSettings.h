@@ -0,0 +1,50 @@
+#ifndef ENCODERSETTINGS_H
+#define ENCODERSETTINGS_H
+
+#include <cstdint>
+#include <string>
+
+struct EncoderSettings {
+  int width = 100;
+  int height = 100;
+  int64_t maxDurationMs = 3000;
+  int64_t maxFileSizeByte = 100000;
+  std::string videoCodec = "libvpx-vp9";
+  std::string outputExtension = ".webm";
+  // Faster sources are decimated right after decode, 0 keeps every frame.
+  int maxOutputFps = 30;
+
+  // Decodes the trimmed window once and re-encodes it with a bisected crf
+  // until the output is the best quality that fits into maxFileSizeByte.
+  bool targetFileSize = true;
+  int minCrf = 4;
+  int maxCrf = 63;
+  // Fast realtime encodes used to bisect the crf before the final encode.
+  int maxProbeEncodes = 5;
+  // Final encodes, each one a crf step above the previous oversized one.
+  int maxFinalEncodes = 3;
+  int finalCrfStep = 4;
+  // An encode whose size, projected from the packets so far, exceeds
+  // maxFileSizeByte by this fraction stops early. A final encode then
+  // retries a crf step up, a streaming one fails. Negative never stops.
+  double earlyAbortMargin = 0.25;
+
+  // Runs decode, scale and encode on separate threads joined by bounded
+  // queues of pipelineDepth frames. Pays off for few long clips, when the
+  // worker pool alone cannot keep the cores busy.
+  bool pipelined = false;
+  int pipelineDepth = 8;
+
+  // Downscales with AreaScaler when the source is large enough, otherwise
+  // and for full range sources with a swscale spline.
+  bool areaDownscale = true;
+  // Unsharp amount after the area downscale, 0 turns it off.
+  double downscaleSharpen = 0.5;
+
+  // libvpx speed for streaming and final encodes, higher is faster.
+  int cpuUsed = 2;
+  // Caps the threads one job leases from the budget, 0 means no cap.
+  int maxThreadsPerJob = 0;
+};
+
+#endif  // ENCODERSETTINGS_H
@@ -0,0 +1,45 @@
+#ifndef FRAMEFEED_H
+#define FRAMEFEED_H
+
+#include <atomic>
+
+#include "FramePool.h"
+#include "StreamingContext.h"
+#include "utility/SpscQueue.h"
+
+// Decoded source frames a shared decode hands to one fan-out branch, in
+// presentation order. The frames reference the decoder's buffers, their
+// structs go back to the decode's pool once the branch is done with them.
+class FrameFeed {
+ public:
+  FrameFeed(size_t depth, FramePool& pool) : frames(depth), pool(pool) {}
+
+  FrameFeed(const FrameFeed&) = delete;
+  FrameFeed& operator=(const FrameFeed&) = delete;
+
+  // Decode side, false once the branch stopped taking frames.
+  bool push(AVFramePtr frame) { return frames.push(std::move(frame)); }
+  // Ends the window. After a failed decode the branch holds a partial
+  // window it must not encode. Only the first call counts, a window the
+  // decode completed stays whole whatever fails later.
+  void close(bool failed = false) {
+    if (closed.exchange(true))
+      return;
+    if (failed)
+      decodeFailed = true;
+    frames.close();
+  }
+
+  // Branch side, false once the window is complete or the decode failed.
+  bool pop(AVFramePtr& frame) { return frames.pop(frame); }
+  void release(AVFramePtr frame) { pool.release(std::move(frame)); }
+  bool failed() const noexcept { return decodeFailed; }
+
+ private:
+  SpscQueue<AVFramePtr> frames;
+  FramePool& pool;
+  std::atomic_bool closed = false;
+  std::atomic_bool decodeFailed = false;
+};
+
+#endif  // FRAMEFEED_H
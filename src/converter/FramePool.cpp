@@ -0,0 +1,99 @@
+#include "FramePool.h"
+
+#include <stdexcept>
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+namespace {
+constexpr auto AllocateAVFrameException =
+    "Failed to allocated memory for AVFrame";
+constexpr auto AllocateBufferPoolException =
+    "Failed to allocated memory for frame buffer pool";
+constexpr auto AllocateFrameBufferException =
+    "Failed to allocated memory for frame buffer";
+}  // namespace
+
+FramePool::~FramePool() {
+  frames.clear();
+  av_buffer_pool_uninit(&buffers);
+}
+
+void FramePool::reset(int width, int height, AVPixelFormat format, int align) {
+  std::lock_guard lock(mutex);
+  // Frames still in flight keep their buffers, the old pool is freed once
+  // the last of them is released.
+  av_buffer_pool_uninit(&buffers);
+
+  this->width = width;
+  this->height = height;
+  this->format = format;
+  this->align = align;
+
+  const auto size = av_image_get_buffer_size(format, width, height, align);
+  buffers = av_buffer_pool_init2(size, this, &FramePool::allocateBuffer,
+                                 nullptr);
+  if (!buffers) {
+    throw std::runtime_error(AllocateBufferPoolException);
+  }
+}
+
+AVFramePtr FramePool::acquire() {
+  auto frame = acquireEmpty();
+
+  {
+    std::lock_guard lock(mutex);
+    frame->buf[0] = av_buffer_pool_get(buffers);
+  }
+  if (!frame->buf[0]) {
+    throw std::runtime_error(AllocateFrameBufferException);
+  }
+
+  frame->format = format;
+  frame->width = width;
+  frame->height = height;
+  av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data,
+                       format, width, height, align);
+
+  return frame;
+}
+
+AVFramePtr FramePool::acquireEmpty() {
+  {
+    std::lock_guard lock(mutex);
+    if (!frames.empty()) {
+      auto frame = std::move(frames.back());
+      frames.pop_back();
+      return frame;
+    }
+  }
+
+  auto frame = AVFramePtr(av_frame_alloc());
+  if (!frame) {
+    throw std::runtime_error(AllocateAVFrameException);
+  }
+  ++frameAllocations;
+  return frame;
+}
+
+void FramePool::release(AVFramePtr frame) {
+  if (!frame)
+    return;
+
+  av_frame_unref(frame.get());
+  std::lock_guard lock(mutex);
+  frames.push_back(std::move(frame));
+}
+
+int64_t FramePool::getBufferAllocations() const noexcept {
+  return bufferAllocations;
+}
+
+int64_t FramePool::getFrameAllocations() const noexcept {
+  return frameAllocations;
+}
+
+AVBufferRef* FramePool::allocateBuffer(void* opaque, size_t size) {
+  ++static_cast<FramePool*>(opaque)->bufferAllocations;
+  return av_buffer_alloc(size);
+}
@@ -0,0 +1,48 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "StreamingContext.h"
+
+// Hands out video frames of one fixed size and format. Pixel buffers come
+// from an AVBufferPool and go back to it when the last reference drops,
+// frame structs are recycled through release. Both sides count their real
+// allocations, so a warmed-up pool shows no growth per frame.
+class FramePool {
+ public:
+  FramePool() = default;
+  ~FramePool();
+
+  FramePool(const FramePool&) = delete;
+  FramePool& operator=(const FramePool&) = delete;
+
+  // Drops the current buffers and sizes the pool for new frames.
+  void reset(int width, int height, AVPixelFormat format, int align = 32);
+
+  // Returns a writable frame backed by a pooled buffer.
+  AVFramePtr acquire();
+  // Returns an empty frame struct, for callers that reference other data.
+  AVFramePtr acquireEmpty();
+  void release(AVFramePtr frame);
+
+  int64_t getBufferAllocations() const noexcept;
+  int64_t getFrameAllocations() const noexcept;
+
+ private:
+  static AVBufferRef* allocateBuffer(void* opaque, size_t size);
+
+  AVBufferPool* buffers = nullptr;
+  std::vector<AVFramePtr> frames;
+  std::mutex mutex;
+  int width = 0;
+  int height = 0;
+  int align = 0;
+  AVPixelFormat format = AV_PIX_FMT_NONE;
+  std::atomic<int64_t> bufferAllocations = 0;
+  std::atomic<int64_t> frameAllocations = 0;
+};
+
+#endif  // FRAMEPOOL_H
@@ -0,0 +1,142 @@
+#include "MemoryOutput.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+namespace {
+constexpr auto AllocateIoContextException = "Failed to allocate io context";
+constexpr auto WriteOutputFileException = "Failed to write output file";
+constexpr auto RenameOutputFileException = "Failed to rename output file";
+constexpr auto PartialSuffix = ".part";
+constexpr auto IoBufferSize = 64 * 1024;
+
+// The buffer lost its const in FFmpeg 7, write callbacks never modify it.
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+using WriteBuffer = const uint8_t*;
+#else
+using WriteBuffer = uint8_t*;
+#endif
+
+}  // namespace
+
+MemoryOutput::MemoryOutput() {
+  reset();
+}
+
+MemoryOutput::~MemoryOutput() {
+  if (ioContext) {
+    av_freep(&ioContext->buffer);
+    avio_context_free(&ioContext);
+  }
+}
+
+AVIOContext* MemoryOutput::context() noexcept {
+  return ioContext;
+}
+
+void MemoryOutput::reset() {
+  // A fresh context drops the position and error state of the last muxer.
+  if (ioContext) {
+    av_freep(&ioContext->buffer);
+    avio_context_free(&ioContext);
+  }
+  length = 0;
+  position = 0;
+
+  auto* buffer = static_cast<unsigned char*>(av_malloc(IoBufferSize));
+  if (!buffer) {
+    throw std::runtime_error(AllocateIoContextException);
+  }
+
+  ioContext = avio_alloc_context(
+      buffer, IoBufferSize, 1, this, nullptr,
+      [](void* opaque, WriteBuffer buffer, int size) {
+        return static_cast<MemoryOutput*>(opaque)->write(buffer, size);
+      },
+      [](void* opaque, int64_t offset, int whence) {
+        return static_cast<MemoryOutput*>(opaque)->seek(offset, whence);
+      });
+  if (!ioContext) {
+    av_free(buffer);
+    throw std::runtime_error(AllocateIoContextException);
+  }
+  // The WebM muxer goes back to fill in sizes, cues and the duration.
+  ioContext->seekable = AVIO_SEEKABLE_NORMAL;
+}
+
+int64_t MemoryOutput::size() {
+  avio_flush(ioContext);
+  return static_cast<int64_t>(length);
+}
+
+void MemoryOutput::commit(const std::string& path) {
+  avio_flush(ioContext);
+
+  const auto partial = path + PartialSuffix;
+  AVIOContext* file = nullptr;
+  if (avio_open(&file, partial.c_str(), AVIO_FLAG_WRITE) < 0) {
+    throw std::runtime_error(WriteOutputFileException);
+  }
+  avio_write(file, data.data(), static_cast<int>(length));
+  avio_flush(file);
+  const auto failed = file->error < 0;
+  if (avio_closep(&file) < 0 || failed) {
+    std::remove(partial.c_str());
+    throw std::runtime_error(WriteOutputFileException);
+  }
+
+  std::error_code error;
+  std::filesystem::rename(std::filesystem::u8path(partial),
+                          std::filesystem::u8path(path), error);
+  if (error) {
+    std::remove(partial.c_str());
+    throw std::runtime_error(RenameOutputFileException);
+  }
+}
+
+int MemoryOutput::write(const uint8_t* buffer, int size) {
+  const auto end = position + static_cast<size_t>(size);
+  if (end > data.size()) {
+    data.resize(std::max(end, data.size() * 2));
+  }
+  std::memcpy(data.data() + position, buffer, size);
+  position = end;
+  length = std::max(length, position);
+
+  return size;
+}
+
+int64_t MemoryOutput::seek(int64_t offset, int whence) {
+  if (whence & AVSEEK_SIZE)
+    return static_cast<int64_t>(length);
+
+  int64_t base = 0;
+  switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = static_cast<int64_t>(position);
+      break;
+    case SEEK_END:
+      base = static_cast<int64_t>(length);
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+
+  const auto target = base + offset;
+  if (target < 0)
+    return AVERROR(EINVAL);
+  // Seeking past the end is allowed, a later write fills the gap.
+  position = static_cast<size_t>(target);
+  return target;
+}
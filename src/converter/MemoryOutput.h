@@ -0,0 +1,42 @@
+#ifndef MEMORYOUTPUT_H
+#define MEMORYOUTPUT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// Growable, seekable in-memory file for a muxer. Nothing reaches the disk
+// until commit, so a failed or oversized encode leaves no partial output
+// behind and retries reuse the same memory.
+class MemoryOutput {
+ public:
+  MemoryOutput();
+  ~MemoryOutput();
+
+  MemoryOutput(const MemoryOutput&) = delete;
+  MemoryOutput& operator=(const MemoryOutput&) = delete;
+
+  // Set as AVFormatContext::pb together with AVFMT_FLAG_CUSTOM_IO.
+  AVIOContext* context() noexcept;
+  // Empties the file, keeps the allocated memory for the next encode.
+  void reset();
+  // Bytes written so far, flushes the AVIO buffer first.
+  int64_t size();
+  // Writes the whole file next to path in one write and renames it into
+  // place, readers see either no file or the complete one.
+  void commit(const std::string& path);
+
+ private:
+  int write(const uint8_t* buffer, int size);
+  int64_t seek(int64_t offset, int whence);
+
+  std::vector<uint8_t> data;
+  size_t length = 0;
+  size_t position = 0;
+  AVIOContext* ioContext = nullptr;
+};
+
+#endif  // MEMORYOUTPUT_H
@@ -0,0 +1,158 @@
+#include "OutputCache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QUuid>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include "ToWebmConvertor.h"
+
+namespace {
+constexpr auto CacheDirectoryName = "TgCreateEmoji/outputs";
+constexpr auto PartialSuffix = ".part";
+// Bumped whenever the encoder changes what a key produces.
+constexpr auto KeyVersion = 1;
+// Head, middle and tail of the input are hashed, reading a large source
+// whole would take longer than some of the encodes it saves.
+constexpr qint64 SampleBytes = 64 * 1024;
+
+std::filesystem::path toPath(const QString& path) {
+  return std::filesystem::path(path.toStdU16String());
+}
+
+}  // namespace
+
+OutputCache::OutputCache(QString directory, int64_t maxBytes)
+    : directory(std::move(directory)), maxBytes(maxBytes) {}
+
+void OutputCache::setMaxBytes(int64_t value) {
+  std::lock_guard lock(mutex);
+  maxBytes = std::max<int64_t>(value, 0);
+}
+
+int64_t OutputCache::getMaxBytes() const {
+  std::lock_guard lock(mutex);
+  return maxBytes;
+}
+
+QString OutputCache::key(const VideoProp& input,
+                         const EncoderSettings& settings) const {
+  if (getMaxBytes() == 0)
+    return QString();
+
+  QFile file(input.path);
+  if (!file.open(QFile::ReadOnly))
+    return QString();
+
+  const auto size = file.size();
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  for (const auto offset : {qint64(0), (size - SampleBytes) / 2,
+                            size - SampleBytes}) {
+    if (!file.seek(std::max<qint64>(offset, 0)))
+      return QString();
+    hash.addData(file.read(SampleBytes));
+  }
+
+  // Threading and pipelining only change how fast the output is made.
+  const auto description =
+      QString("%1|%2|%3|%4|%5|%6x%7|%8|%9|%10|%11")
+          .arg(KeyVersion)
+          .arg(size)
+          .arg(QFileInfo(file).lastModified().toMSecsSinceEpoch())
+          .arg(input.beginPosMs)
+          .arg(input.endPosMs)
+          .arg(settings.width)
+          .arg(settings.height)
+          .arg(settings.maxDurationMs)
+          .arg(settings.maxFileSizeByte)
+          .arg(QString::fromStdString(settings.videoCodec))
+          .arg(QString::fromStdString(settings.outputExtension)) +
+      QString("|%1|%2|%3|%4|%5|%6|%7|%8|%9|%10|%11")
+          .arg(settings.maxOutputFps)
+          .arg(settings.targetFileSize)
+          .arg(settings.minCrf)
+          .arg(settings.maxCrf)
+          .arg(settings.maxProbeEncodes)
+          .arg(settings.maxFinalEncodes)
+          .arg(settings.finalCrfStep)
+          .arg(settings.earlyAbortMargin)
+          .arg(settings.cpuUsed)
+          .arg(settings.areaDownscale)
+          .arg(settings.downscaleSharpen);
+  hash.addData(description.toUtf8());
+
+  return QString::fromLatin1(hash.result().toHex());
+}
+
+bool OutputCache::restore(const QString& key, const QString& path) const {
+  if (key.isEmpty())
+    return false;
+
+  const auto entry = entryPath(key);
+  std::error_code error;
+  std::filesystem::create_hard_link(toPath(entry), toPath(path), error);
+  if (error && !QFile::copy(entry, path))
+    return false;
+
+  // Marks the entry as recently used for eviction.
+  QFile touched(entry);
+  if (touched.open(QFile::Append))
+    touched.setFileTime(QDateTime::currentDateTime(),
+                        QFileDevice::FileModificationTime);
+  return true;
+}
+
+void OutputCache::store(const QString& key, const QString& path) {
+  if (key.isEmpty() || getMaxBytes() == 0)
+    return;
+
+  QDir().mkpath(directory);
+  const auto entry = entryPath(key);
+  // Copied aside and renamed, so a concurrent restore never sees half an
+  // entry. A copy rather than a link keeps later edits of the output out.
+  const auto partial =
+      entry + '.' + QUuid::createUuid().toString(QUuid::StringFormat::Id128) +
+      PartialSuffix;
+  if (!QFile::copy(path, partial))
+    return;
+  if (!QFile::rename(partial, entry))
+    QFile::remove(partial);
+
+  evict();
+}
+
+QString OutputCache::defaultDirectory() {
+  return QDir(QStandardPaths::writableLocation(
+                  QStandardPaths::GenericCacheLocation))
+      .absoluteFilePath(CacheDirectoryName);
+}
+
+QString OutputCache::entryPath(const QString& key) const {
+  return QDir(directory).absoluteFilePath(key);
+}
+
+void OutputCache::evict() {
+  std::lock_guard lock(mutex);
+
+  // Oldest first, restore refreshes the modification time.
+  const auto entries = QDir(directory).entryInfoList(
+      QDir::Files, QDir::Time | QDir::Reversed);
+  int64_t total = 0;
+  for (const auto& entry : entries)
+    total += entry.size();
+
+  for (const auto& entry : entries) {
+    if (total <= maxBytes)
+      break;
+    if (entry.fileName().endsWith(PartialSuffix))
+      continue;
+    if (QFile::remove(entry.absoluteFilePath()))
+      total -= entry.size();
+  }
+}
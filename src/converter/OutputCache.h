@@ -0,0 +1,47 @@
+#ifndef OUTPUTCACHE_H
+#define OUTPUTCACHE_H
+
+#include <QString>
+#include <cstdint>
+#include <mutex>
+
+#include "EncoderSettings.h"
+
+struct VideoProp;
+
+// Finished outputs stored by a hash of the input, the trim window and the
+// settings that shape the encode. A repeated conversion is linked or
+// copied out of the cache instead of being encoded again. The directory
+// is bounded by size, least recently used outputs go first.
+class OutputCache {
+ public:
+  explicit OutputCache(QString directory = defaultDirectory(),
+                       int64_t maxBytes = DefaultMaxBytes);
+
+  OutputCache(const OutputCache&) = delete;
+  OutputCache& operator=(const OutputCache&) = delete;
+
+  // 0 disables the cache, a smaller bound applies with the next store.
+  void setMaxBytes(int64_t value);
+  int64_t getMaxBytes() const;
+
+  // Empty when the input can not be read or the cache is disabled.
+  QString key(const VideoProp& input, const EncoderSettings& settings) const;
+  // Hard links, or copies across file systems, a cached output to path.
+  // A linked output shares its data with the cache entry.
+  bool restore(const QString& key, const QString& path) const;
+  void store(const QString& key, const QString& path);
+
+  static QString defaultDirectory();
+  static constexpr int64_t DefaultMaxBytes = 256 * 1024 * 1024;
+
+ private:
+  QString entryPath(const QString& key) const;
+  void evict();
+
+  const QString directory;
+  mutable std::mutex mutex;
+  int64_t maxBytes = DefaultMaxBytes;
+};
+
+#endif  // OUTPUTCACHE_H
@@ -0,0 +1,68 @@
+#include "OutputProfiles.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+constexpr auto StickerSide = 512;
+constexpr int64_t StickerMaxFileSizeByte = 256 * 1024;
+
+}  // namespace
+
+EncoderSettings OutputProfile::applyTo(EncoderSettings settings) const {
+  settings.width = width;
+  settings.height = height;
+  settings.maxDurationMs = maxDurationMs;
+  settings.maxFileSizeByte = maxFileSizeByte;
+  settings.videoCodec = videoCodec;
+  settings.outputExtension = outputExtension;
+  return settings;
+}
+
+OutputProfiles::OutputProfiles() {
+  OutputProfile emoji;
+  emoji.name = Emoji;
+  profiles.push_back(std::move(emoji));
+
+  OutputProfile sticker;
+  sticker.name = Sticker;
+  sticker.width = StickerSide;
+  sticker.height = StickerSide;
+  sticker.maxFileSizeByte = StickerMaxFileSizeByte;
+  profiles.push_back(std::move(sticker));
+}
+
+void OutputProfiles::add(OutputProfile profile) {
+  std::lock_guard lock(mutex);
+  const auto existing =
+      std::find_if(profiles.begin(), profiles.end(),
+                   [&profile](const OutputProfile& other) {
+                     return other.name == profile.name;
+                   });
+  if (existing != profiles.end())
+    *existing = std::move(profile);
+  else
+    profiles.push_back(std::move(profile));
+}
+
+std::optional<OutputProfile> OutputProfiles::find(const QString& name) const {
+  std::lock_guard lock(mutex);
+  for (const auto& profile : profiles) {
+    if (profile.name == name)
+      return profile;
+  }
+  return std::nullopt;
+}
+
+QStringList OutputProfiles::names() const {
+  std::lock_guard lock(mutex);
+  QStringList result;
+  for (const auto& profile : profiles)
+    result.append(profile.name);
+  return result;
+}
+
+OutputProfiles& OutputProfiles::shared() {
+  static OutputProfiles profiles;
+  return profiles;
+}
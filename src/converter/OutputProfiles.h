@@ -0,0 +1,55 @@
+#ifndef OUTPUTPROFILES_H
+#define OUTPUTPROFILES_H
+
+#include <QString>
+#include <QStringList>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "EncoderSettings.h"
+
+// The shape of one kind of output. Everything else about an encode, crf
+// search, threads, pipelining, comes from the convertor's settings.
+struct OutputProfile {
+  QString name;
+  int width = 100;
+  int height = 100;
+  int64_t maxDurationMs = 3000;
+  int64_t maxFileSizeByte = 100000;
+  std::string videoCodec = "libvpx-vp9";
+  std::string outputExtension = ".webm";
+
+  // Copies the shape into settings, the rest stays.
+  EncoderSettings applyTo(EncoderSettings settings) const;
+};
+
+// Output profiles by name. Starts with the Telegram emoji and video
+// sticker formats, more can be registered. Safe to use from several
+// threads.
+class OutputProfiles {
+ public:
+  OutputProfiles();
+
+  OutputProfiles(const OutputProfiles&) = delete;
+  OutputProfiles& operator=(const OutputProfiles&) = delete;
+
+  // Replaces a profile of the same name.
+  void add(OutputProfile profile);
+  std::optional<OutputProfile> find(const QString& name) const;
+  QStringList names() const;
+
+  // Process-wide registry.
+  static OutputProfiles& shared();
+
+  static constexpr auto Emoji = "emoji";
+  static constexpr auto Sticker = "sticker";
+
+ private:
+  mutable std::mutex mutex;
+  std::vector<OutputProfile> profiles;
+};
+
+#endif  // OUTPUTPROFILES_H
@@ -0,0 +1,78 @@
+#ifndef STREAMINGCONTEXT_H
+#define STREAMINGCONTEXT_H
+
+#include <memory>
+#include <string>
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+struct StreamingContext {
+  AVFormatContext* formatContext = nullptr;
+  AVCodec* codec = nullptr;
+  AVStream* stream = nullptr;
+  AVCodecContext* codecContext = nullptr;
+  int video_index = 0;
+  std::string filename;
+};
+
+struct StreamingContextDeleter {
+  void operator()(StreamingContext* context) {
+    if (context) {
+      auto* avfc = &context->formatContext;
+      auto* avcc = &context->codecContext;
+      if (avfc)
+        avformat_close_input(avfc);
+      if (avcc)
+        avcodec_free_context(avcc);
+      if (context->formatContext)
+        avformat_free_context(context->formatContext);
+    }
+  }
+};
+
+struct AVFrameDeleter {
+  void operator()(AVFrame* frame) {
+    if (frame)
+      av_frame_free(&frame);
+  }
+};
+
+struct AVPacketDeleter {
+  void operator()(AVPacket* packet) {
+    if (packet)
+      av_packet_free(&packet);
+  }
+};
+
+struct AVCodecContextDeleter {
+  void operator()(AVCodecContext* context) {
+    if (context)
+      avcodec_free_context(&context);
+  }
+};
+
+struct SwsContextDeleter {
+  void operator()(SwsContext* context) {
+    if (context)
+      sws_freeContext(context);
+  }
+};
+
+struct AVDictionaryDeleter {
+  void operator()(AVDictionary* dictionary) {
+    if (dictionary)
+      av_dict_free(&dictionary);
+  }
+};
+
+using ContextPtr = std::unique_ptr<StreamingContext, StreamingContextDeleter>;
+using AVFramePtr = std::unique_ptr<AVFrame, AVFrameDeleter>;
+using AVPacketPtr = std::unique_ptr<AVPacket, AVPacketDeleter>;
+using AVCodecContextPtr =
+    std::unique_ptr<AVCodecContext, AVCodecContextDeleter>;
+using SwsContextPtr = std::unique_ptr<SwsContext, SwsContextDeleter>;
+
+#endif  // STREAMINGCONTEXT_H
@@ -1,471 +1,480 @@
 #include "ToWebmConvertor.h"
 
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
+#include <QFileInfo>
+#include <QHash>
 #include <QString>
+#include <QStringList>
 #include <QUuid>
+#include <algorithm>
 #include <exception>
-#include <future>
 #include <memory>
-extern "C" {
-#include <inttypes.h>
-#include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
-#include <libavutil/imgutils.h>
-#include <libavutil/opt.h>
-#include <libavutil/timestamp.h>
-#include <libswscale/swscale.h>
-}
-
-namespace {
+#include <numeric>
+#include <utility>
 
-constexpr auto MaxDurationMs = 3000;
-constexpr auto MaxFileSizeByte = 100000;
-constexpr auto Width = 100;
-constexpr auto Height = 100;
-constexpr auto OutputExtension = ".webm";
-constexpr auto VideoCodec = "libvpx-vp9";
-
-constexpr auto OpenOutputFileException = "Failed to opening output file";
-constexpr auto WriteHeaderFileException = "Failed to write header output file";
-constexpr auto AllocateAVFrameException =
-    "Failed to allocated memory for AVFrame";
-constexpr auto AllocateAVPacketException =
-    "Failed to allocated memory for AVPacket";
-constexpr auto AllocateOutputFormatException =
-    "Failed to allocated memory for output format";
-constexpr auto AllocateAVFormatContextException =
-    "Failed to allocated memory for AVFormat context";
-constexpr auto AllocateCodecContextException =
-    "Failed to allocated memory for codec context";
-constexpr auto FindCodecException = "Failed to find the proper codec";
-constexpr auto OpenCodecException = "Failed to open the codec";
-constexpr auto FillCodecContextException = "Failed to fill codec context";
-constexpr auto OpenInputFileException = "Failed to open input file";
-constexpr auto FindStreamInfoException = "Failed to get find info";
-constexpr auto ReceivingPacketEncoderException =
-    "Failed to receiving packet from encoder";
-constexpr auto ReceivingPacketDecoderException =
-    "Failed to receiving packet from decoder";
-constexpr auto SendongPacketDecoderException =
-    "Error while sending packet to decoder";
-constexpr auto ReceivingFrameDecoderException =
-    "Error while receiving frame from decoder";
-
-struct StreamingParams {
-  std::string outputExtension;
-  std::string muxerOptKey;
-  std::string muxerOptValue;
-  std::string videoCodec;
-  std::string codecPrivKey;
-  std::string codecPrivValue;
-};
+#include "BatchJournal.h"
+#include "OutputProfiles.h"
+#include "VideoTranscoder.h"
+#include "utility/MediaProbe.h"
+#include "utility/Tracer.h"
 
-struct StreamingContext {
-  AVFormatContext* formatContext = nullptr;
-  AVCodec* codec = nullptr;
-  AVStream* stream = nullptr;
-  AVCodecContext* codecContext = nullptr;
-  int video_index = 0;
-  std::string filename;
-};
-
-struct StreamingContextDeleter {
-  void operator()(StreamingContext* context) {
-    if (context) {
-      auto* avfc = &context->formatContext;
-      auto* avcc = &context->codecContext;
-      if (avfc)
-        avformat_close_input(avfc);
-      if (avcc)
-        avcodec_free_context(avcc);
-      if (context->formatContext)
-        avformat_free_context(context->formatContext);
-    }
-  }
+namespace {
+constexpr auto DefaultFps = 30.0;
+// Assumed for files the probe cache does not know yet.
+constexpr auto DefaultWidth = 1920;
+constexpr auto DefaultHeight = 1080;
+// Every output of a shared decode encodes on a thread of its own and the
+// group's lease holds a thread for each, see also the thread budget cap in
+// push. Larger groups would crowd out the other jobs.
+constexpr size_t MaxGroupJobs = 8;
+
+struct CodecCost {
+  const char* codec;
+  double weight;
 };
 
-struct AVFrameDeleter {
-  void operator()(AVFrame* frame) {
-    if (frame)
-      av_frame_free(&frame);
-  }
+// Decode time per pixel relative to H.264, for the codecs phones and
+// screen recorders produce. Anything else counts as H.264.
+constexpr CodecCost CodecCosts[] = {
+    {"mjpeg", 0.7}, {"mpeg4", 0.7}, {"prores", 0.8}, {"vp8", 1.0},
+    {"h264", 1.0},  {"vp9", 1.5},   {"hevc", 1.8},   {"av1", 2.5},
 };
 
-struct AVPacketDeleter {
-  void operator()(AVPacket* packet) {
-    if (packet)
-      av_packet_free(&packet);
+double codecWeight(const QString& codec) {
+  for (const auto& cost : CodecCosts) {
+    if (codec == cost.codec)
+      return cost.weight;
   }
-};
+  return 1.0;
+}
 
-struct SwsContextDeleter {
-  void operator()(SwsContext* context) {
-    if (context)
-      sws_freeContext(context);
+// Decode work of a job: source pixels of the frames from the keyframe
+// before the window to its end, weighted by codec. Runs on the thread that
+// pushes, so it only looks at the probe cache. A file it does not know
+// counts as a full length window of 1080p H.264 without pre-roll.
+int64_t estimateCost(const VideoProp& input, const EncoderSettings& settings) {
+  const auto info = MediaProbe::shared().cached(input.path);
+
+  auto windowMs = input.endPosMs - input.beginPosMs;
+  if (windowMs <= 0)
+    windowMs = info ? info->durationMs - input.beginPosMs : 0;
+  if (windowMs <= 0)
+    windowMs = settings.maxDurationMs;
+  windowMs = std::clamp<int64_t>(windowMs, 1, settings.maxDurationMs);
+  if (!info) {
+    return static_cast<int64_t>(windowMs * DefaultFps / 1000 * DefaultWidth *
+                                DefaultHeight);
   }
-};
 
-struct AVDictionaryDeleter {
-  void operator()(AVDictionary* dictionary) {
-    if (dictionary)
-      av_dict_free(&dictionary);
-  }
-};
+  const auto& keyframes = info->keyframesMs;
+  const auto next =
+      std::upper_bound(keyframes.begin(), keyframes.end(), input.beginPosMs);
+  const auto preRollMs =
+      next != keyframes.begin() ? input.beginPosMs - *std::prev(next) : 0;
 
-QString getResponse(int code) {
-  char error[AV_ERROR_MAX_STRING_SIZE];
-  av_make_error_string(error, AV_ERROR_MAX_STRING_SIZE, code);
-  return QString(error);
+  const auto fps = info->fps > 0 ? info->fps : DefaultFps;
+  const auto frames = (windowMs + preRollMs) * fps / 1000;
+  return static_cast<int64_t>(frames * info->width * info->height *
+                              codecWeight(info->codec));
 }
 
-using ContextPtr = std::unique_ptr<StreamingContext, StreamingContextDeleter>;
-
-class VideoTranscoder : public QObject {
-  Q_OBJECT
-  using AVFramePtr = std::unique_ptr<AVFrame, AVFrameDeleter>;
-  using AVPacketPtr = std::unique_ptr<AVPacket, AVPacketDeleter>;
-  using SwsContextPtr = std::unique_ptr<SwsContext, SwsContextDeleter>;
-
- signals:
-  void updateProgress(QUuid taskId, int progress);
-
- public:
-  VideoTranscoder(ContextPtr encoder, ContextPtr decoder)
-      : _encoder(std::move(encoder)), _decoder(std::move(decoder)) {}
-
-  void process(const VideoProp& input) {
-    AVDictionary* muxer_opts = nullptr;
+}  // namespace
 
-    /*if (!sp.muxer_opt_key.empty() && !sp.muxer_opt_value.empty()) {
-      av_dict_set(&muxer_opts, sp.muxer_opt_key.c_str(),
-                  sp.muxer_opt_value.c_str(), 0);
-    }*/
+ToWebmConvertor::ToWebmConvertor(QObject* parent) : QObject(parent) {
+  connect(&progress, &ProgressAggregator::progressChanged, this,
+          &ToWebmConvertor::progressChanged);
+}
 
-    open_media();
-    prepare_decoder();
-    prepare_video_encoder();
+ToWebmConvertor::~ToWebmConvertor() {
+  cancelled = true;
+  pool.stop();
+}
 
-    if (avformat_write_header(_encoder->formatContext, &muxer_opts) < 0) {
-      throw std::exception(WriteHeaderFileException);
+void ToWebmConvertor::push(QString output, std::vector<VideoProp> input) {
+  // Only workers decrement, a batch that is idle here stays idle.
+  if (activeJobs.load() == 0)
+    batchBeginNs = Tracer::now();
+  activeJobs += static_cast<int>(input.size());
+
+  // Pushed in the order the pool would pick them, a job pushed early
+  // would otherwise take a free worker before cheaper ones are queued.
+  std::vector<int64_t> costs(input.size());
+  if (schedulingPolicy == SchedulingPolicy::ShortestFirst) {
+    for (size_t i = 0; i < input.size(); ++i)
+      costs[i] = estimateCost(input[i], settings);
+  }
+  std::vector<size_t> order(input.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+    return std::make_pair(-input[lhs].priority, costs[lhs]) <
+           std::make_pair(-input[rhs].priority, costs[rhs]);
+  });
+
+  // Jobs cutting from the same file share one decode, up to MaxGroupJobs
+  // of them and no more encoders than the thread budget holds. A group has
+  // the priority of its first job and the summed cost of all, and is
+  // pushed in that order again.
+  const auto outputs = resolveOutputs();
+  const auto groupJobs = std::clamp<size_t>(
+      budget.getTotal() / std::max<size_t>(outputs.size(), 1), 1,
+      MaxGroupJobs);
+  std::vector<std::vector<size_t>> groups;
+  QHash<QString, size_t> openGroups;
+  for (const auto i : order) {
+    const auto found = sharedDecode ? openGroups.constFind(input[i].path)
+                                    : openGroups.constEnd();
+    if (found != openGroups.constEnd() &&
+        groups[*found].size() < groupJobs) {
+      groups[*found].push_back(i);
+    } else {
+      openGroups.insert(input[i].path, groups.size());
+      groups.push_back({i});
     }
+  }
 
-    auto inputFrame = AVFramePtr(av_frame_alloc());
-    if (!inputFrame) {
-      throw std::exception(AllocateAVFrameException);
+  std::vector<int64_t> groupCosts(groups.size());
+  for (size_t g = 0; g < groups.size(); ++g) {
+    for (const auto i : groups[g])
+      groupCosts[g] += costs[i];
+  }
+  std::vector<size_t> groupOrder(groups.size());
+  std::iota(groupOrder.begin(), groupOrder.end(), 0);
+  std::stable_sort(
+      groupOrder.begin(), groupOrder.end(), [&](size_t lhs, size_t rhs) {
+        return std::make_pair(-input[groups[lhs].front()].priority,
+                              groupCosts[lhs]) <
+               std::make_pair(-input[groups[rhs].front()].priority,
+                              groupCosts[rhs]);
+      });
+
+  for (const auto g : groupOrder) {
+    std::vector<Job> jobs;
+    for (const auto i : groups[g]) {
+      auto& item = input[i];
+      if (journal)
+        journal->queued(item, output);
+      auto progressSlot = progress.track(item.uuid);
+      jobs.push_back({std::move(item), std::move(progressSlot)});
     }
+    const auto priority = jobs.front().input.priority;
+    pool.push(
+        [this, jobs = std::move(jobs), output, outputs,
+         traceDirectory = traceDirectory, queuedNs = Tracer::now()]() {
+          {
+            TraceScope scope("convert", "scheduler");
+            scope.setArg("queuedUs", (Tracer::now() - queuedNs) / 1000);
+            convert(jobs, output, outputs);
+          }
+          for (size_t i = 0; i < jobs.size(); ++i)
+            finishJob(traceDirectory);
+        },
+        priority, groupCosts[g]);
+  }
+}
 
-    auto inputPacket = AVPacketPtr(av_packet_alloc());
-    if (!inputPacket) {
-      throw std::exception(AllocateAVPacketException);
-    }
+void ToWebmConvertor::setMaxConcurrency(int value) {
+  pool.setMaxConcurrency(std::max(value, 1));
+}
 
-    auto scaleContext = SwsContextPtr(sws_getContext(
-        _decoder->codecContext->width, _decoder->codecContext->height,
-        _decoder->codecContext->pix_fmt, Width, Height,
-        _encoder->codecContext->pix_fmt, SWS_SPLINE, nullptr, nullptr,
-        nullptr));
+int ToWebmConvertor::getMaxConcurrency() const {
+  return static_cast<int>(pool.getMaxConcurrency());
+}
 
-    auto** streams = _decoder->formatContext->streams;
+void ToWebmConvertor::setEncoderSettings(EncoderSettings value) {
+  settings = std::move(value);
+}
 
-    _fps = streams[inputPacket->stream_index]->avg_frame_rate;
+const EncoderSettings& ToWebmConvertor::getEncoderSettings() const {
+  return settings;
+}
 
-    //   static_cast<double>(
-    // //     streams[inputPacket->stream_index]->avg_frame_rate.num) /
-    // streams[inputPacket->stream_index]->avg_frame_rate.den;
+void ToWebmConvertor::setOutputProfiles(QStringList value) {
+  outputProfiles = std::move(value);
+}
 
-    const int64_t beginFrame = input.beginPosMs * _fps.num / (1000 * _fps.den);
-    const int64_t endFrame = input.endPosMs * _fps.num / (1000 * _fps.den);
-    const int64_t totalFrames = endFrame - beginFrame;
+QStringList ToWebmConvertor::getOutputProfiles() const {
+  return outputProfiles;
+}
 
-    int64_t count = 0;
-    int progress = 0;
+void ToWebmConvertor::setThreadBudget(int value) {
+  budget.setTotal(value);
+}
 
-    int64_t startTime =
-        av_rescale_q(input.beginPosMs * AV_TIME_BASE / 1000, {1, AV_TIME_BASE},
-                     _decoder->stream->time_base);
+int ToWebmConvertor::getThreadBudget() const {
+  return budget.getTotal();
+}
 
-    if (startTime > 0) {
-      av_seek_frame(_decoder->formatContext, inputPacket->stream_index,
-                    startTime, 0);
-      avcodec_flush_buffers(_decoder->codecContext);
-    }
+void ToWebmConvertor::setOutputCacheSize(int64_t value) {
+  cache.setMaxBytes(value);
+}
 
-    while (count < totalFrames &&
-           av_read_frame(_decoder->formatContext, inputPacket.get()) >= 0) {
-      const auto codec_type =
-          streams[inputPacket->stream_index]->codecpar->codec_type;
+int64_t ToWebmConvertor::getOutputCacheSize() const {
+  return cache.getMaxBytes();
+}
 
-      if (codec_type == AVMEDIA_TYPE_VIDEO) {
-        transcode_video(inputPacket.get(), inputFrame.get(),
-                        scaleContext.get());
+void ToWebmConvertor::setTraceDirectory(QString value) {
+  traceDirectory = std::move(value);
+  Tracer::setEnabled(!traceDirectory.isEmpty());
+}
 
-        if (const auto pg = (count * 100) / totalFrames; pg != progress) {
-          progress = pg;
-          emit updateProgress(input.uuid, progress);
-        }
+QString ToWebmConvertor::getTraceDirectory() const {
+  return traceDirectory;
+}
 
-        ++count;
-      }
-      av_packet_unref(inputPacket.get());
-    }
+void ToWebmConvertor::setSchedulingPolicy(SchedulingPolicy value) {
+  schedulingPolicy = value;
+}
 
-    encode_video(nullptr, nullptr);
-    av_write_trailer(_encoder->formatContext);
+ToWebmConvertor::SchedulingPolicy ToWebmConvertor::getSchedulingPolicy()
+    const {
+  return schedulingPolicy;
+}
 
-    emit updateProgress(input.uuid, 100);
-  }
+void ToWebmConvertor::setSharedDecode(bool value) {
+  sharedDecode = value;
+}
 
- private:
-  void prepare_decoder() {
-    for (int i = 0; i < _decoder->formatContext->nb_streams; i++) {
-      if (_decoder->formatContext->streams[i]->codecpar->codec_type ==
-          AVMEDIA_TYPE_VIDEO) {
-        _decoder->stream = _decoder->formatContext->streams[i];
-        _decoder->video_index = i;
+bool ToWebmConvertor::getSharedDecode() const {
+  return sharedDecode;
+}
 
-        fill_stream_info(_decoder->stream, &_decoder->codec,
-                         &_decoder->codecContext);
-      }
-    }
+void ToWebmConvertor::setJournalFile(QString value) {
+  // The old journal flushes on destruction.
+  journal.reset();
+  if (!value.isEmpty()) {
+    QDir().mkpath(QFileInfo(value).absolutePath());
+    journal = std::make_unique<BatchJournal>(std::move(value));
   }
+}
 
-  void prepare_video_encoder() {
-    avformat_alloc_output_context2(&_encoder->formatContext, nullptr, nullptr,
-                                   _encoder->filename.c_str());
-    if (!_encoder->formatContext) {
-      throw std::exception(AllocateOutputFormatException);
-    }
-
-    AVRational input_framerate =
-        av_guess_frame_rate(_decoder->formatContext, _decoder->stream, nullptr);
-
-    _encoder->stream = avformat_new_stream(_encoder->formatContext, nullptr);
-
-    _encoder->codec =
-        const_cast<AVCodec*>(avcodec_find_encoder_by_name(VideoCodec));
-    if (!_encoder->codec) {
-      throw std::exception(FindCodecException);
-    }
-
-    _encoder->codecContext = avcodec_alloc_context3(_encoder->codec);
-    if (!_encoder->codecContext) {
-      throw std::exception(AllocateCodecContextException);
-    }
-
-    if (_encoder->codecContext->codec_id == AV_CODEC_ID_H264)
-      av_opt_set(_encoder->codecContext->priv_data, "preset", "slow", 0);
-    else
-      av_opt_set(_encoder->codecContext->priv_data, "preset", "fast", 0);
-
-    _encoder->codecContext->height = Height;
-    _encoder->codecContext->width = Width;
-    _encoder->codecContext->sample_aspect_ratio = {Width, Height};
-    if (_encoder->codec->pix_fmts)
-      _encoder->codecContext->pix_fmt = _encoder->codec->pix_fmts[0];
-    else
-      _encoder->codecContext->pix_fmt = _decoder->codecContext->pix_fmt;
-
-    constexpr int64_t maxBitrate =
-        MaxFileSizeByte / (MaxDurationMs / 1000.0) - 1;
-
-    _encoder->codecContext->max_b_frames = _decoder->codecContext->max_b_frames;
-    _encoder->codecContext->bit_rate =
-        std::min(maxBitrate, _decoder->codecContext->bit_rate);
-    _encoder->codecContext->rc_buffer_size = MaxFileSizeByte;
-    _encoder->codecContext->rc_max_rate =
-        std::min(maxBitrate, _decoder->codecContext->rc_max_rate);
-    _encoder->codecContext->rc_min_rate =
-        std::min(maxBitrate, _decoder->codecContext->rc_min_rate);
-    _encoder->codecContext->time_base = av_inv_q(input_framerate);
-    _encoder->stream->time_base = _encoder->codecContext->time_base;
-
-    if (avcodec_open2(_encoder->codecContext, _encoder->codec, nullptr) < 0) {
-      throw std::exception(OpenCodecException);
-    }
-    avcodec_parameters_from_context(_encoder->stream->codecpar,
-                                    _encoder->codecContext);
-
-    if (_encoder->formatContext->oformat->flags & AVFMT_GLOBALHEADER)
-      _encoder->formatContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-
-    if (!(_encoder->formatContext->oformat->flags & AVFMT_NOFILE)) {
-      if (avio_open(&_encoder->formatContext->pb, _encoder->filename.c_str(),
-                    AVIO_FLAG_WRITE) < 0) {
-        throw std::exception(OpenOutputFileException);
-      }
-    }
+std::vector<VideoProp> ToWebmConvertor::resume() {
+  if (!journal)
+    return {};
+
+  std::vector<VideoProp> resumed;
+  QHash<QString, std::vector<VideoProp>> byOutputDir;
+  QStringList outputDirs;
+  for (const auto& job : journal->unfinished()) {
+    if (!byOutputDir.contains(job.outputDir))
+      outputDirs.append(job.outputDir);
+    byOutputDir[job.outputDir].push_back(job.prop);
+    resumed.push_back(job.prop);
   }
+  for (const auto& outputDir : outputDirs)
+    push(outputDir, byOutputDir.take(outputDir));
 
-  void fill_stream_info(AVStream* avs, AVCodec** avc, AVCodecContext** avcc) {
-    *avc = const_cast<AVCodec*>(avcodec_find_decoder(avs->codecpar->codec_id));
-    if (!*avc) {
-      throw std::exception(FindCodecException);
-    }
-
-    *avcc = avcodec_alloc_context3(*avc);
-    if (!*avcc) {
-      throw std::exception(AllocateCodecContextException);
-    }
-
-    if (avcodec_parameters_to_context(*avcc, avs->codecpar) < 0) {
-      throw std::exception(FillCodecContextException);
-    }
+  return resumed;
+}
 
-    if (avcodec_open2(*avcc, *avc, nullptr) < 0) {
-      throw std::exception(OpenCodecException);
-    }
+std::vector<VideoProp> ToWebmConvertor::unfinished() const {
+  std::vector<VideoProp> jobs;
+  if (journal) {
+    for (const auto& job : journal->unfinished())
+      jobs.push_back(job.prop);
   }
+  return jobs;
+}
 
-  void open_media() {
-    auto** avfc = &_decoder->formatContext;
-    *avfc = avformat_alloc_context();
-    if (!*avfc) {
-      throw std::exception(AllocateAVFormatContextException);
-    }
-
-    if (avformat_open_input(avfc, _decoder->filename.c_str(), nullptr,
-                            nullptr) != 0) {
-      throw std::exception(OpenInputFileException);
-    }
-
-    if (avformat_find_stream_info(*avfc, nullptr) < 0) {
-      throw std::exception(FindStreamInfoException);
-    }
+std::vector<VideoProp> ToWebmConvertor::abandoned() const {
+  std::vector<VideoProp> jobs;
+  if (journal) {
+    for (const auto& job : journal->abandoned())
+      jobs.push_back(job.prop);
   }
+  return jobs;
+}
 
-  void encode_video(AVFrame* inputFrame, SwsContext* scale) {
-    if (inputFrame) {
-      inputFrame->pict_type = AV_PICTURE_TYPE_NONE;
-    }
-
-    AVPacket* output_packet = av_packet_alloc();
-    if (!output_packet) {
-      throw std::exception(AllocateAVPacketException);
-    }
+void ToWebmConvertor::discardUnfinished() {
+  if (journal)
+    journal->discardUnfinished();
+}
 
-    AVFramePtr scaledFrame = nullptr;
-
-    if (inputFrame && scale) {
-      scaledFrame = AVFramePtr(av_frame_alloc());
-      scaledFrame->format = inputFrame->format;
-      scaledFrame->width = Width;
-      scaledFrame->height = Height;
-      // scaledFrame->channels = inputFrame->channels;
-      // scaledFrame->channel_layout = inputFrame->channel_layout;
-      scaledFrame->nb_samples = inputFrame->nb_samples;
-      av_frame_get_buffer(scaledFrame.get(), 32);
-      av_frame_copy_props(scaledFrame.get(), inputFrame);
-
-      const auto pixFormat = static_cast<AVPixelFormat>(inputFrame->format);
-      auto* out_buffer = static_cast<std::uint8_t*>(
-          av_malloc(av_image_get_buffer_size(pixFormat, Width, Height, 32)));
-      av_image_fill_arrays(scaledFrame->data, scaledFrame->linesize, out_buffer,
-                           pixFormat, Width, Height, 32);
-
-      sws_scale(scale, inputFrame->data, inputFrame->linesize, 0,
-                _decoder->codecContext->height, scaledFrame->data,
-                scaledFrame->linesize);
-    }
+void ToWebmConvertor::finishJob(const QString& traceDirectory) {
+  if (--activeJobs > 0 || traceDirectory.isEmpty())
+    return;
 
-    int response =
-        avcodec_send_frame(_encoder->codecContext, scaledFrame.get());
-    while (response >= 0) {
-      response = avcodec_receive_packet(_encoder->codecContext, output_packet);
-      if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-        break;
-      } else if (response < 0) {
-        throw std::exception(ReceivingPacketDecoderException);
-      }
+  QDir().mkpath(traceDirectory);
+  const auto fileName =
+      traceDirectory + "/trace-" +
+      QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz") + ".json";
+  if (Tracer::shared().write(fileName, batchBeginNs))
+    qDebug() << "trace written to" << fileName;
+}
 
-      const auto frameDuration =
-          _decoder->stream->time_base.den * _fps.den / _fps.num;
-      const int64_t frameTime = current_frame * frameDuration;
-      output_packet->pts = frameTime / _decoder->stream->time_base.num;
-      output_packet->duration = frameDuration;
-      output_packet->dts = output_packet->pts;
-      output_packet->stream_index = _decoder->stream->index;
-      av_packet_rescale_ts(output_packet, _decoder->stream->time_base,
-                           _encoder->stream->time_base);
-
-      ++current_frame;
-
-      response =
-          av_interleaved_write_frame(_encoder->formatContext, output_packet);
-      if (response != 0) {
-        throw std::exception(ReceivingPacketDecoderException);
-      }
-    }
-    av_packet_unref(output_packet);
-    av_packet_free(&output_packet);
+std::vector<ToWebmConvertor::Output> ToWebmConvertor::resolveOutputs() const {
+  std::vector<Output> outputs;
+  for (const auto& name : outputProfiles) {
+    if (const auto profile = OutputProfiles::shared().find(name))
+      outputs.push_back({name, profile->applyTo(settings)});
+    else
+      qDebug() << "unknown output profile" << name;
   }
+  if (outputs.empty())
+    outputs.push_back({QString(), settings});
+  return outputs;
+}
 
-  void transcode_video(AVPacket* input_packet,
-                       AVFrame* input_frame,
-                       SwsContext* scale) {
-    int response = avcodec_send_packet(_decoder->codecContext, input_packet);
-    if (response < 0) {
-      throw std::exception(SendongPacketDecoderException);
-    }
-
-    while (response >= 0) {
-      response = avcodec_receive_frame(_decoder->codecContext, input_frame);
-      if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-        break;
-      } else if (response < 0) {
-        throw std::exception(ReceivingFrameDecoderException);
+void ToWebmConvertor::convert(const std::vector<Job>& jobs,
+                              QString output,
+                              std::vector<Output> outputs) {
+  struct Result {
+    QString path;
+    QString cacheKey;
+    QString error;
+    bool restored = false;
+  };
+  // Results of one job by output, written by the branch encoding it. The
+  // branch that brings pending to zero completes the job.
+  struct JobState {
+    explicit JobState(size_t outputs) : results(outputs), progress(outputs) {}
+    std::vector<Result> results;
+    std::vector<std::atomic_int> progress;
+    std::atomic_int pending{0};
+  };
+
+  std::vector<std::unique_ptr<JobState>> states;
+  std::vector<VideoTranscoder::Branch> branches;
+  // Job and output index of every branch.
+  std::vector<std::pair<size_t, size_t>> targets;
+  for (size_t j = 0; j < jobs.size(); ++j) {
+    const auto& input = jobs[j].input;
+    if (journal)
+      journal->running(input.uuid);
+
+    auto state = std::make_unique<JobState>(outputs.size());
+    // One name for all outputs of a job, profiles tell them apart.
+    const auto baseName =
+        output + '/' +
+        QUuid::createUuid().toString(QUuid::StringFormat::Id128);
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      const auto& settings = outputs[i].settings;
+      auto& result = state->results[i];
+      result.path = baseName +
+                    (outputs[i].profile.isEmpty() ? QString()
+                                                  : '-' + outputs[i].profile) +
+                    QString::fromStdString(settings.outputExtension);
+      result.cacheKey = cache.key(input, settings);
+      result.restored = cache.restore(result.cacheKey, result.path);
+      if (result.restored) {
+        state->progress[i] = 100;
+        continue;
       }
 
-      if (response >= 0) {
-        encode_video(input_frame, scale);
-      }
-      av_frame_unref(input_frame);
+      auto encoder = ContextPtr(new StreamingContext);
+      encoder->filename = result.path.toStdString();
+      branches.push_back({input, settings, std::move(encoder)});
+      targets.emplace_back(j, i);
+      ++state->pending;
     }
+    states.push_back(std::move(state));
   }
 
- private:
-  ContextPtr _encoder = nullptr;
-  ContextPtr _decoder = nullptr;
-  size_t current_frame = 0;
-  AVRational _fps = {};
-};
-
-}  // namespace
+  const auto complete = [this, &jobs, &outputs, &states](size_t index) {
+    const auto& job = jobs[index];
+    auto& results = states[index]->results;
+    QString error;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      const auto& result = results[i];
+      if (result.error.isEmpty() && !result.restored)
+        cache.store(result.cacheKey, result.path);
+      if (!result.error.isEmpty() && error.isEmpty())
+        error = result.error;
+      if (!outputs[i].profile.isEmpty()) {
+        emit outputFinished(job.input.uuid, outputs[i].profile,
+                            result.error.isEmpty() ? result.path : QString(),
+                            result.error);
+      }
+    }
 
-ToWebmConvertor::ToWebmConvertor(QObject* parent) : QObject(parent) {}
+    if (!error.isEmpty()) {
+      // Jobs cancelled by shutting down stay unfinished and resume later,
+      // without the run counting against them.
+      if (journal && cancelled)
+        journal->interrupted(job.input.uuid);
+      else if (journal)
+        journal->failed(job.input.uuid, error);
+      job.progress->finish(-1);
+      emit finished(job.input.uuid, QString(), error);
+      return;
+    }
 
-void ToWebmConvertor::push(QString output, std::vector<VideoProp> input) {
-  for (auto item : input) {
-    std::thread(&ToWebmConvertor::convert, this, std::move(item), output)
-        .detach();
+    if (journal)
+      journal->done(job.input.uuid, results.front().path);
+    job.progress->finish(100);
+    emit finished(job.input.uuid, results.front().path, QString());
+  };
+  const auto report = [&states, &targets, &complete](size_t branch,
+                                                     QString error) {
+    const auto [job, index] = targets[branch];
+    auto& state = *states[job];
+    state.results[index].error = std::move(error);
+    if (--state.pending == 0)
+      complete(job);
+  };
+
+  for (size_t j = 0; j < jobs.size(); ++j) {
+    if (states[j]->pending == 0)
+      complete(j);
   }
-}
-
-int ToWebmConvertor::convert(VideoProp input, QString output) {
-  auto inputStd = input.path.toStdString();
-  auto outputStd =
-      (output + '/' + QUuid::createUuid().toString(QUuid::StringFormat::Id128))
-          .toStdString() +
-      OutputExtension;
+  if (branches.empty())
+    return;
 
   auto decoder = ContextPtr(new StreamingContext);
-  auto encoder = ContextPtr(new StreamingContext);
-
-  encoder->filename = std::move(outputStd);
-  decoder->filename = std::move(inputStd);
-
-  VideoTranscoder transcoder(std::move(encoder), std::move(decoder));
-  QObject::connect(&transcoder, &VideoTranscoder::updateProgress, this,
-                   &ToWebmConvertor::updateProgress);
-
-  try {
-    transcoder.process(input);
-  } catch (std::exception& ex) {
-    qDebug() << ex.what();
-    emit updateProgress(input.uuid, -1);
-    return -1;
+  decoder->filename = jobs.front().input.path.toStdString();
+  const auto expectedJobs = std::min(pool.runningCount() + pool.pendingCount(),
+                                     pool.getMaxConcurrency());
+
+  if (branches.size() == 1) {
+    auto& branch = branches.front();
+    const auto input = branch.input;
+    VideoTranscoder transcoder(std::move(branch.encoder), std::move(decoder),
+                               std::move(branch.settings), &cancelled);
+    // Direct connection, a report is a store into the job's slot.
+    auto& progressSlot = *jobs[targets.front().first].progress;
+    QObject::connect(
+        &transcoder, &VideoTranscoder::updateProgress,
+        [&progressSlot](QUuid, int value) { progressSlot.set(value); });
+    transcoder.setThreadBudget(&budget, static_cast<int>(expectedJobs));
+
+    try {
+      transcoder.process(input);
+    } catch (std::exception& ex) {
+      qDebug() << ex.what();
+      report(0, QString(ex.what()));
+      return;
+    }
+    report(0, QString());
+    return;
   }
 
-  return 0;
+  // Decoder settings, threads and queue depth, are the same for all.
+  VideoTranscoder transcoder(ContextPtr(), std::move(decoder),
+                             branches.front().settings, &cancelled);
+  transcoder.setThreadBudget(&budget, static_cast<int>(expectedJobs));
+  transcoder.processBranches(
+      std::move(branches),
+      // A job moves at the average pace of its outputs.
+      [&jobs, &states, &targets](size_t branch, int value) {
+        const auto [job, index] = targets[branch];
+        auto& progress = states[job]->progress;
+        progress[index] = value;
+        int total = 0;
+        for (const auto& part : progress)
+          total += part;
+        jobs[job].progress->set(total / static_cast<int>(progress.size()));
+      },
+      [&report](size_t branch, std::exception_ptr error) {
+        if (!error) {
+          report(branch, QString());
+          return;
+        }
+        try {
+          std::rethrow_exception(error);
+        } catch (std::exception& ex) {
+          qDebug() << ex.what();
+          report(branch, QString(ex.what()));
+        }
+      });
 }
-#include "ToWebmConvertor.moc"
@@ -1,31 +1,137 @@
 #ifndef VIDEOTOGIFCONVERTER_H
 #define VIDEOTOGIFCONVERTER_H
 #include <QObject>
+#include <QStringList>
 #include <QUuid>
+#include <atomic>
+#include <memory>
 #include <tuple>
 #include <vector>
+
+#include "EncoderSettings.h"
+#include "OutputCache.h"
+#include "utility/ProgressAggregator.h"
+#include "utility/ThreadBudget.h"
+#include "utility/ThreadPool.h"
 class QString;
 
-class QStringList;
+class BatchJournal;
 
 struct VideoProp {
   QUuid uuid;
   QString path;
   int64_t beginPosMs = 0;
   int64_t endPosMs = 0;
+  // Pinned by the user, a higher priority starts first whatever the job
+  // is estimated to cost.
+  int priority = 0;
 };
 
 class ToWebmConvertor final : public QObject {
   Q_OBJECT
  public:
+  enum class SchedulingPolicy {
+    // Jobs of equal priority start in push order.
+    Fifo,
+    // Jobs of equal priority start by estimated cost, cheapest first, so
+    // short clips finish while a long one still waits for a worker.
+    ShortestFirst,
+  };
+
   ToWebmConvertor(QObject* parent = nullptr);
+  ~ToWebmConvertor();
   void push(QString output, std::vector<VideoProp> input);
+  void setMaxConcurrency(int value);
+  int getMaxConcurrency() const;
+  // Applies to conversions pushed after the call.
+  void setEncoderSettings(EncoderSettings value);
+  const EncoderSettings& getEncoderSettings() const;
+  // Encodes every clip once per named profile, see OutputProfiles, all
+  // from a single decode. Empty, the default, encodes once with the
+  // encoder settings as they are. Applies to conversions pushed after the
+  // call.
+  void setOutputProfiles(QStringList value);
+  QStringList getOutputProfiles() const;
+  // Codec threads shared by all running jobs, defaults to the core count.
+  void setThreadBudget(int value);
+  int getThreadBudget() const;
+  // Bound of the output cache in bytes, 0 turns it off.
+  void setOutputCacheSize(int64_t value);
+  int64_t getOutputCacheSize() const;
+  // Writes a Chrome trace of every batch into the directory, from the
+  // first push while idle until the last of its jobs ends. Empty turns
+  // tracing off.
+  void setTraceDirectory(QString value);
+  QString getTraceDirectory() const;
+  // Applies to conversions pushed after the call.
+  void setSchedulingPolicy(SchedulingPolicy value);
+  SchedulingPolicy getSchedulingPolicy() const;
+  // Jobs cutting from the same file share one decode pass, which only
+  // decodes the union of their windows. On by default, applies to
+  // conversions pushed after the call.
+  void setSharedDecode(bool value);
+  bool getSharedDecode() const;
+  // Records the state of every job pushed after the call in the file, see
+  // BatchJournal. Call while no conversion runs, empty turns it off.
+  void setJournalFile(QString value);
+  // Pushes the jobs the journal's previous session left unfinished again,
+  // each to the directory it was pushed to, and returns them. Jobs that
+  // finished are not repeated.
+  std::vector<VideoProp> resume();
+  // The jobs resume would push, without pushing them.
+  std::vector<VideoProp> unfinished() const;
+  // Jobs that were running each time one of the last sessions died, given
+  // up instead of resumed, see BatchJournal::MaxAttempts.
+  std::vector<VideoProp> abandoned() const;
+  // Drops the jobs resume would push, later sessions do not offer them.
+  void discardUnfinished();
  signals:
-  void updateProgress(QUuid taskId, int progress);
+  // Progress of all jobs that changed since the last batch, delivered at
+  // a fixed rate on the thread the convertor lives in. -1 means failed.
+  void progressChanged(const std::vector<ProgressUpdate>& updates);
+  // Emitted once per job, error is empty when the output was written.
+  void finished(QUuid taskId, QString outputPath, QString error);
+  // Emitted per profile of a job converted with output profiles, before
+  // its finished. finished then carries the output of the first profile
+  // and fails when any of the outputs did.
+  void outputFinished(QUuid taskId,
+                      QString profile,
+                      QString outputPath,
+                      QString error);
 
  private:
-  int convert(VideoProp input, QString output);
+  struct Output {
+    // Empty without output profiles.
+    QString profile;
+    EncoderSettings settings;
+  };
+
+  struct Job {
+    VideoProp input;
+    std::shared_ptr<ProgressSlot> progress;
+  };
+
+  std::vector<Output> resolveOutputs() const;
+  // Converts jobs of one source into every output. A single encode runs
+  // on the calling thread, more share a decode, see processBranches.
+  void convert(const std::vector<Job>& jobs,
+               QString output,
+               std::vector<Output> outputs);
+  void finishJob(const QString& traceDirectory);
   std::vector<QString> paths;
+  EncoderSettings settings;
+  QStringList outputProfiles;
+  SchedulingPolicy schedulingPolicy = SchedulingPolicy::ShortestFirst;
+  bool sharedDecode = true;
+  std::atomic_bool cancelled = false;
+  QString traceDirectory;
+  std::atomic_int activeJobs{0};
+  std::atomic<int64_t> batchBeginNs{0};
+  ProgressAggregator progress;
+  ThreadBudget budget;
+  OutputCache cache;
+  std::unique_ptr<BatchJournal> journal;
+  ThreadPool pool;
 };
 
 #endif  // VIDEOTOGIFCONVERTER_H
@@ -0,0 +1,1194 @@
+#include "VideoTranscoder.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#include "utility/SpscQueue.h"
+#include "utility/Tracer.h"
+extern "C" {
+#include <inttypes.h>
+#include <libavutil/cpu.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/timestamp.h>
+}
+
+namespace {
+
+constexpr auto WriteHeaderFileException = "Failed to write header output file";
+constexpr auto AllocateAVFrameException =
+    "Failed to allocated memory for AVFrame";
+constexpr auto AllocateAVPacketException =
+    "Failed to allocated memory for AVPacket";
+constexpr auto AllocateOutputFormatException =
+    "Failed to allocated memory for output format";
+constexpr auto AllocateAVFormatContextException =
+    "Failed to allocated memory for AVFormat context";
+constexpr auto AllocateCodecContextException =
+    "Failed to allocated memory for codec context";
+constexpr auto FindCodecException = "Failed to find the proper codec";
+constexpr auto OpenCodecException = "Failed to open the codec";
+constexpr auto FillCodecContextException = "Failed to fill codec context";
+constexpr auto OpenInputFileException = "Failed to open input file";
+constexpr auto FindStreamInfoException = "Failed to get find info";
+constexpr auto FindVideoStreamException = "Failed to find a video stream";
+constexpr auto ReceivingPacketEncoderException =
+    "Failed to receiving packet from encoder";
+constexpr auto ReceivingPacketDecoderException =
+    "Failed to receiving packet from decoder";
+constexpr auto SendingFrameEncoderException =
+    "Error while sending frame to encoder";
+constexpr auto SendongPacketDecoderException =
+    "Error while sending packet to decoder";
+constexpr auto ReceivingFrameDecoderException =
+    "Error while receiving frame from decoder";
+constexpr auto WritePacketException = "Failed to write packet to output file";
+constexpr auto EmptyWindowException = "No video frames in the selected range";
+constexpr auto OversizedOutputException =
+    "Failed to fit output into the file size limit";
+constexpr auto CancelledException = "Conversion was cancelled";
+constexpr auto PipelineStoppedException = "Pipeline stage stopped";
+constexpr auto AllocateScaleContextException =
+    "Failed to allocated memory for scale context";
+
+constexpr auto ProbeDeadline = "realtime";
+constexpr auto FinalDeadline = "good";
+constexpr auto ProbeCpuUsed = 8;
+
+// Source area one decoder thread is expected to keep up with.
+constexpr auto PixelsPerDecoderThread = 640 * 360;
+// VP9 tiles are at least 256 pixels wide, row-mt works on 64 pixel rows.
+constexpr auto MinTileWidth = 256;
+constexpr auto SuperblockSize = 64;
+
+// Rough WebM container cost added to the probe packet sizes.
+constexpr auto WebmHeaderBytes = 512;
+constexpr auto WebmBytesPerFrame = 16;
+
+constexpr AVRational MsTimeBase = {1, 1000};
+// Used when the container gives no usable frame rate at all.
+constexpr AVRational FallbackFrameRate = {30, 1};
+
+// Share of the frames encoded before a projection may stop an encode, the
+// first keyframe alone would project far too high.
+constexpr auto MinProjectedShare = 0.3;
+
+constexpr auto DecodeProgress = 40;
+constexpr auto ProbeProgress = 80;
+
+// Adds the wall time of one call to a per-stage total, and records it as a
+// trace event named after the stage while tracing is on.
+template <class Function>
+auto timed(int64_t& totalUs, const char* stage, Function&& function) {
+  const TraceScope scope(stage, "transcode");
+  const auto start = std::chrono::steady_clock::now();
+  const auto elapsedUs = [&start] {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+
+  if constexpr (std::is_void_v<decltype(function())>) {
+    function();
+    totalUs += elapsedUs();
+  } else {
+    auto result = function();
+    totalUs += elapsedUs();
+    return result;
+  }
+}
+
+void accumulate(TranscodeStats& total, const TranscodeStats& part) {
+  total.decodedFrames += part.decodedFrames;
+  total.scaledFrames += part.scaledFrames;
+  total.droppedFrames += part.droppedFrames;
+  total.demuxUs += part.demuxUs;
+  total.decodeUs += part.decodeUs;
+  total.scaleUs += part.scaleUs;
+  total.encodeUs += part.encodeUs;
+  total.muxUs += part.muxUs;
+  total.frameAllocations += part.frameAllocations;
+  total.bufferAllocations += part.bufferAllocations;
+  total.packetAllocations += part.packetAllocations;
+  total.copiedFrames += part.copiedFrames;
+  total.copiedBytes += part.copiedBytes;
+  total.earlyAborts += part.earlyAborts;
+}
+
+}  // namespace
+
+VideoTranscoder::VideoTranscoder(ContextPtr encoder,
+                                 ContextPtr decoder,
+                                 EncoderSettings settings,
+                                 const std::atomic_bool* cancelled)
+    : _encoder(std::move(encoder)),
+      _decoder(std::move(decoder)),
+      _source(_decoder.get()),
+      _settings(std::move(settings)),
+      _cancelled(cancelled) {}
+
+void VideoTranscoder::setThreadBudget(ThreadBudget* budget, int expectedJobs) {
+  _budget = budget;
+  _expectedJobs = expectedJobs;
+}
+
+void VideoTranscoder::process(const VideoProp& input) {
+  open_media();
+  prepare_decoder();
+  transcode_window(input);
+}
+
+void VideoTranscoder::processBranches(std::vector<Branch> branches,
+                                      const BranchProgress& progress,
+                                      const BranchDone& done) {
+  try {
+    open_media();
+    // The shared decoder and every branch encoder run side by side.
+    prepare_decoder(static_cast<int>(branches.size()) + 1);
+  } catch (...) {
+    const auto error = std::current_exception();
+    for (size_t i = 0; i < branches.size(); ++i)
+      done(i, error);
+    return;
+  }
+
+  std::vector<VideoProp> inputs;
+  std::vector<EncoderSettings> settings;
+  std::vector<std::unique_ptr<FrameFeed>> feeds;
+  std::vector<std::unique_ptr<VideoTranscoder>> transcoders;
+  for (size_t i = 0; i < branches.size(); ++i) {
+    auto& branch = branches[i];
+    inputs.push_back(branch.input);
+    settings.push_back(branch.settings);
+    feeds.push_back(
+        std::make_unique<FrameFeed>(_settings.pipelineDepth, _framePool));
+
+    auto transcoder = std::make_unique<VideoTranscoder>(
+        std::move(branch.encoder), nullptr, std::move(branch.settings),
+        _cancelled);
+    transcoder->_source = _source;
+    transcoder->_feed = feeds.back().get();
+    transcoder->_threadCount = _threadCount;
+    // Direct connection, reports come from the branch thread.
+    QObject::connect(transcoder.get(), &VideoTranscoder::updateProgress,
+                     [&progress, i](QUuid, int value) { progress(i, value); });
+    transcoders.push_back(std::move(transcoder));
+  }
+
+  std::exception_ptr decodeError;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < transcoders.size(); ++i) {
+    threads.emplace_back([&, i]() {
+      Tracer::setThreadName("fan-out branch");
+      std::exception_ptr error;
+      try {
+        transcoders[i]->transcode_window(inputs[i]);
+      } catch (...) {
+        // A branch cut short by the decode reports why the decode failed.
+        error = feeds[i]->failed() && decodeError ? decodeError
+                                                  : std::current_exception();
+      }
+      // Nothing more is queued for a failed branch.
+      feeds[i]->close();
+      done(i, error);
+    });
+  }
+
+  try {
+    decode_branches(inputs, settings, feeds);
+  } catch (...) {
+    decodeError = std::current_exception();
+  }
+  // Feeds of windows decoded in full were closed already and stay whole.
+  for (auto& feed : feeds)
+    feed->close(decodeError != nullptr);
+  for (auto& thread : threads)
+    thread.join();
+
+  for (const auto& transcoder : transcoders)
+    accumulate(_stats, transcoder->getStats());
+}
+
+void VideoTranscoder::transcode_window(const VideoProp& input) {
+  _encoder->codec = const_cast<AVCodec*>(
+      avcodec_find_encoder_by_name(_settings.videoCodec.c_str()));
+  if (!_encoder->codec) {
+    throw std::runtime_error(FindCodecException);
+  }
+
+  if (_encoder->codec->pix_fmts)
+    _pixFormat = _encoder->codec->pix_fmts[0];
+  else
+    _pixFormat = _source->codecContext->pix_fmt;
+
+  _frameRate =
+      av_guess_frame_rate(_source->formatContext, _source->stream, nullptr);
+  if (_frameRate.num <= 0 || _frameRate.den <= 0)
+    _frameRate = FallbackFrameRate;
+  const AVRational maxFrameRate = {_settings.maxOutputFps, 1};
+  if (_settings.maxOutputFps > 0 && av_cmp_q(_frameRate, maxFrameRate) > 0)
+    _frameRate = maxFrameRate;
+  // Aligned for the widest SIMD the encoder may use on this CPU, so frames
+  // are scaled straight into buffers it can read by reference.
+  _framePool.reset(_settings.width, _settings.height, _pixFormat,
+                   static_cast<int>(av_cpu_max_align()));
+
+  const auto* decoderContext = _source->codecContext;
+  auto scaleContext = SwsContextPtr(sws_getContext(
+      decoderContext->width, decoderContext->height, decoderContext->pix_fmt,
+      _settings.width, _settings.height, _pixFormat, SWS_SPLINE, nullptr,
+      nullptr, nullptr));
+  if (_settings.areaDownscale &&
+      AreaScaler::supports(decoderContext->width, decoderContext->height,
+                           decoderContext->pix_fmt,
+                           decoderContext->color_range, _settings.width,
+                           _settings.height, _pixFormat)) {
+    _areaScaler = std::make_unique<AreaScaler>(
+        decoderContext->width, decoderContext->height, decoderContext->pix_fmt,
+        _settings.width, _settings.height, _settings.downscaleSharpen);
+  }
+
+  if (_settings.targetFileSize)
+    process_size_targeted(input, scaleContext.get());
+  else
+    process_streaming(input, scaleContext.get());
+
+  emit updateProgress(input.uuid, 100);
+}
+
+TranscodeStats VideoTranscoder::getStats() const {
+  auto stats = _stats;
+  stats.frameAllocations += _framePool.getFrameAllocations();
+  stats.bufferAllocations += _framePool.getBufferAllocations();
+  stats.copiedFrames += _copiedFrames;
+  stats.copiedBytes += _copiedBytes;
+  return stats;
+}
+
+void VideoTranscoder::process_streaming(const VideoProp& input,
+                                        SwsContext* scale) {
+  AVDictionary* muxer_opts = nullptr;
+
+  prepare_video_encoder();
+  _streamProjection = {expected_frames(input), WebmHeaderBytes, 0};
+
+  if (avformat_write_header(_encoder->formatContext, &muxer_opts) < 0) {
+    throw std::runtime_error(WriteHeaderFileException);
+  }
+
+  read_scaled_window(
+      input, scale,
+      [this](AVFramePtr frame) {
+        encode_video(frame.get());
+        _framePool.release(std::move(frame));
+      },
+      0, 100);
+
+  encode_video(nullptr);
+  av_write_trailer(_encoder->formatContext);
+
+  const auto size = _output.size();
+  if (size > _settings.maxFileSizeByte) {
+    qDebug() << "streaming encode produced" << size << "bytes, limit is"
+             << _settings.maxFileSizeByte;
+    throw std::runtime_error(OversizedOutputException);
+  }
+  timed(_stats.muxUs, "commit", [this] { _output.commit(_encoder->filename); });
+}
+
+void VideoTranscoder::process_size_targeted(const VideoProp& input,
+                                            SwsContext* scale) {
+  _bitRate = budget_bitrate(input);
+
+  // The window is decoded and scaled once, every encode below reuses it.
+  std::vector<AVFramePtr> frames;
+  read_scaled_window(
+      input, scale,
+      [&frames](AVFramePtr frame) { frames.push_back(std::move(frame)); },
+      0, DecodeProgress);
+
+  if (frames.empty()) {
+    throw std::runtime_error(EmptyWindowException);
+  }
+
+  const auto budget = _settings.maxFileSizeByte;
+  int low = _settings.minCrf;
+  int high = _settings.maxCrf;
+  int crf = _settings.maxCrf;
+
+  for (int i = 0; i < _settings.maxProbeEncodes && low <= high; ++i) {
+    const int middle = low + (high - low) / 2;
+    if (probe_encode(frames, middle) <= budget) {
+      crf = middle;
+      high = middle - 1;
+    } else {
+      low = middle + 1;
+    }
+
+    emit updateProgress(input.uuid,
+                        DecodeProgress + (ProbeProgress - DecodeProgress) *
+                                             (i + 1) /
+                                             _settings.maxProbeEncodes);
+  }
+
+  for (int i = 0; i < _settings.maxFinalEncodes; ++i) {
+    const auto size = final_encode(frames, crf);
+    if (size <= budget) {
+      timed(_stats.muxUs, "commit",
+            [this] { _output.commit(_encoder->filename); });
+      return;
+    }
+
+    qDebug() << "crf" << crf << "produced" << size << "bytes, limit is"
+             << budget;
+    if (crf == _settings.maxCrf) {
+      break;
+    }
+    crf = std::min(crf + _settings.finalCrfStep, _settings.maxCrf);
+  }
+
+  throw std::runtime_error(OversizedOutputException);
+}
+
+// Seeks to the keyframe before beginPosMs and hands the sink only frames
+// whose pts lies in [beginPosMs, endPosMs). Frames before the window are
+// decoded for reference but never scaled, non-reference ones are skipped by
+// the decoder, and demuxing stops at the first packet decoded after the end.
+// Frames are decimated down to _frameRate here, before anything scales or
+// encodes them, and leave with their output frame index as pts.
+void VideoTranscoder::read_window(const VideoProp& input,
+                                  const FrameSink& sink,
+                                  int progressBegin,
+                                  int progressEnd) {
+  auto* stream = _source->stream;
+  const auto endPosMs =
+      std::min(input.endPosMs, input.beginPosMs + _settings.maxDurationMs);
+  const int64_t startTime =
+      stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+  const int64_t beginPts =
+      startTime + av_rescale_q(input.beginPosMs, MsTimeBase, stream->time_base);
+  const int64_t endPts =
+      startTime + av_rescale_q(endPosMs, MsTimeBase, stream->time_base);
+  const int64_t windowPts = std::max<int64_t>(endPts - beginPts, 1);
+
+  if (!_feed && input.beginPosMs > 0) {
+    av_seek_frame(_decoder->formatContext, _decoder->video_index, beginPts,
+                  AVSEEK_FLAG_BACKWARD);
+    avcodec_flush_buffers(_decoder->codecContext);
+  }
+
+  int progress = progressBegin;
+  int64_t lastSlot = -1;
+  const FrameSink trim = [&](AVFrame* frame) {
+    const auto pts = frame->best_effort_timestamp;
+    if (pts != AV_NOPTS_VALUE && (pts < beginPts || pts >= endPts)) {
+      return;
+    }
+
+    // Each output frame index takes the first frame rounding to it, the
+    // rest of a faster source is dropped.
+    const auto slot =
+        pts != AV_NOPTS_VALUE
+            ? av_rescale_q_rnd(pts - beginPts, stream->time_base,
+                               av_inv_q(_frameRate), AV_ROUND_NEAR_INF)
+            : lastSlot + 1;
+    if (slot <= lastSlot) {
+      ++_stats.droppedFrames;
+      return;
+    }
+    lastSlot = slot;
+    frame->pts = slot;
+
+    sink(frame);
+
+    if (pts != AV_NOPTS_VALUE) {
+      const auto pg = static_cast<int>(
+          progressBegin +
+          (pts - beginPts) * (progressEnd - progressBegin) / windowPts);
+      if (pg != progress) {
+        progress = pg;
+        emit updateProgress(input.uuid, progress);
+      }
+    }
+  };
+
+  if (_feed) {
+    AVFramePtr frame;
+    while (_feed->pop(frame)) {
+      check_cancelled();
+      trim(frame.get());
+      _feed->release(std::move(frame));
+    }
+    if (_feed->failed()) {
+      throw std::runtime_error(PipelineStoppedException);
+    }
+    return;
+  }
+
+  auto inputFrame = AVFramePtr(av_frame_alloc());
+  if (!inputFrame) {
+    throw std::runtime_error(AllocateAVFrameException);
+  }
+
+  auto inputPacket = AVPacketPtr(av_packet_alloc());
+  if (!inputPacket) {
+    throw std::runtime_error(AllocateAVPacketException);
+  }
+
+  auto* codecContext = _decoder->codecContext;
+  auto* formatContext = _decoder->formatContext;
+  while (timed(_stats.demuxUs, "demux", [formatContext, &inputPacket] {
+           return av_read_frame(formatContext, inputPacket.get());
+         }) >= 0) {
+    check_cancelled();
+
+    if (inputPacket->stream_index != _decoder->video_index) {
+      av_packet_unref(inputPacket.get());
+      continue;
+    }
+
+    // Decode order timestamps only grow, so nothing after this packet can
+    // land inside the window any more.
+    const auto dts = inputPacket->dts != AV_NOPTS_VALUE ? inputPacket->dts
+                                                        : inputPacket->pts;
+    if (dts != AV_NOPTS_VALUE && dts >= endPts) {
+      av_packet_unref(inputPacket.get());
+      break;
+    }
+
+    const bool preRoll =
+        inputPacket->pts != AV_NOPTS_VALUE && inputPacket->pts < beginPts;
+    codecContext->skip_frame = preRoll ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+
+    transcode_video(inputPacket.get(), inputFrame.get(), trim);
+    av_packet_unref(inputPacket.get());
+  }
+
+  codecContext->skip_frame = AVDISCARD_DEFAULT;
+  transcode_video(nullptr, inputFrame.get(), trim);
+}
+
+void VideoTranscoder::read_scaled_window(const VideoProp& input,
+                                         SwsContext* scale,
+                                         const ScaledFrameSink& sink,
+                                         int progressBegin,
+                                         int progressEnd) {
+  if (_settings.pipelined) {
+    read_window_pipelined(input, scale, sink, progressBegin, progressEnd);
+    return;
+  }
+
+  read_window(
+      input,
+      [this, scale, &sink](AVFrame* frame) { sink(scale_frame(frame, scale)); },
+      progressBegin, progressEnd);
+}
+
+// Demux and decode run on the calling thread, scaling and the sink get a
+// thread each. Bounded queues between them apply backpressure, and a
+// failing stage closes both queues so the others unwind.
+void VideoTranscoder::read_window_pipelined(const VideoProp& input,
+                                            SwsContext* scale,
+                                            const ScaledFrameSink& sink,
+                                            int progressBegin,
+                                            int progressEnd) {
+  SpscQueue<AVFramePtr> decoded(_settings.pipelineDepth);
+  SpscQueue<AVFramePtr> scaled(_settings.pipelineDepth);
+  std::exception_ptr decodeError;
+  std::exception_ptr scaleError;
+  std::exception_ptr sinkError;
+
+  const auto stopAll = [&decoded, &scaled]() {
+    decoded.close();
+    scaled.close();
+  };
+
+  std::thread scaler([this, scale, &decoded, &scaled, &scaleError,
+                      &stopAll]() {
+    Tracer::setThreadName("pipeline scaler");
+    try {
+      AVFramePtr frame;
+      while (decoded.pop(frame)) {
+        auto scaledFrame = scale_frame(frame.get(), scale);
+        _framePool.release(std::move(frame));
+        if (!scaled.push(std::move(scaledFrame)))
+          break;
+      }
+    } catch (...) {
+      scaleError = std::current_exception();
+      stopAll();
+    }
+    scaled.close();
+  });
+
+  std::thread writer([&sink, &scaled, &sinkError, &stopAll]() {
+    Tracer::setThreadName("pipeline writer");
+    try {
+      AVFramePtr frame;
+      while (scaled.pop(frame)) {
+        sink(std::move(frame));
+      }
+    } catch (...) {
+      sinkError = std::current_exception();
+      stopAll();
+    }
+  });
+
+  try {
+    read_window(
+        input,
+        [this, &decoded](AVFrame* frame) {
+          auto copy = _framePool.acquireEmpty();
+          account_reference(frame);
+          if (av_frame_ref(copy.get(), frame) < 0) {
+            throw std::runtime_error(AllocateAVFrameException);
+          }
+          if (!decoded.push(std::move(copy))) {
+            throw std::runtime_error(PipelineStoppedException);
+          }
+        },
+        progressBegin, progressEnd);
+  } catch (...) {
+    decodeError = std::current_exception();
+    stopAll();
+  }
+  decoded.close();
+
+  scaler.join();
+  writer.join();
+
+  for (const auto& error : {scaleError, sinkError, decodeError}) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+// Like read_window for several windows at once. Each decoded frame goes to
+// every branch whose window holds it, and a branch's feed is closed by the
+// first frame past its window, decoders emit frames in presentation order.
+// Gaps between windows are skipped by a seek whenever the demuxer index
+// has a keyframe inside them, so only the union of the windows and their
+// pre-roll is decoded.
+void VideoTranscoder::decode_branches(
+    const std::vector<VideoProp>& inputs,
+    const std::vector<EncoderSettings>& settings,
+    std::vector<std::unique_ptr<FrameFeed>>& feeds) {
+  struct Route {
+    int64_t beginPts = 0;
+    int64_t endPts = 0;
+    FrameFeed* feed = nullptr;
+    bool started = false;
+    bool open = true;
+  };
+
+  auto* stream = _decoder->stream;
+  const int64_t startTime =
+      stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+  std::vector<Route> routes;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    const auto& input = inputs[i];
+    const auto endPosMs =
+        std::min(input.endPosMs, input.beginPosMs + settings[i].maxDurationMs);
+    routes.push_back(
+        {startTime +
+             av_rescale_q(input.beginPosMs, MsTimeBase, stream->time_base),
+         startTime + av_rescale_q(endPosMs, MsTimeBase, stream->time_base),
+         feeds[i].get()});
+  }
+  if (routes.empty())
+    return;
+
+  const auto openRoutes = [&routes]() {
+    return std::any_of(routes.begin(), routes.end(),
+                       [](const Route& route) { return route.open; });
+  };
+  const auto firstBegin = [&routes]() {
+    auto pts = INT64_MAX;
+    for (const auto& route : routes) {
+      if (route.open)
+        pts = std::min(pts, route.beginPts);
+    }
+    return pts;
+  };
+  const auto lastEnd = [&routes]() {
+    auto pts = INT64_MIN;
+    for (const auto& route : routes) {
+      if (route.open)
+        pts = std::max(pts, route.endPts);
+    }
+    return pts;
+  };
+
+  const auto beginPts = firstBegin();
+  if (beginPts > startTime) {
+    av_seek_frame(_decoder->formatContext, _decoder->video_index, beginPts,
+                  AVSEEK_FLAG_BACKWARD);
+    avcodec_flush_buffers(_decoder->codecContext);
+  }
+
+  const FrameSink routeFrame = [this, &routes](AVFrame* frame) {
+    const auto pts = frame->best_effort_timestamp;
+    for (auto& route : routes) {
+      if (!route.open)
+        continue;
+      if (pts != AV_NOPTS_VALUE && pts >= route.endPts) {
+        route.feed->close();
+        route.open = false;
+        continue;
+      }
+      if (pts == AV_NOPTS_VALUE ? !route.started : pts < route.beginPts)
+        continue;
+
+      route.started = true;
+      auto copy = _framePool.acquireEmpty();
+      account_reference(frame);
+      if (av_frame_ref(copy.get(), frame) < 0) {
+        throw std::runtime_error(AllocateAVFrameException);
+      }
+      // Refused once the branch failed, it gets nothing more.
+      if (!route.feed->push(std::move(copy)))
+        route.open = false;
+    }
+  };
+
+  auto inputFrame = AVFramePtr(av_frame_alloc());
+  auto inputPacket = AVPacketPtr(av_packet_alloc());
+  if (!inputFrame || !inputPacket) {
+    throw std::runtime_error(AllocateAVFrameException);
+  }
+
+  auto* codecContext = _decoder->codecContext;
+  auto* formatContext = _decoder->formatContext;
+  // Begin of the window last seeked to, a keyframe indexed by pts lies
+  // past the dts it is demuxed with and must not trigger a second seek.
+  auto seekedTo = beginPts;
+  while (openRoutes() &&
+         timed(_stats.demuxUs, "demux", [formatContext, &inputPacket] {
+           return av_read_frame(formatContext, inputPacket.get());
+         }) >= 0) {
+    check_cancelled();
+
+    if (inputPacket->stream_index != _decoder->video_index) {
+      av_packet_unref(inputPacket.get());
+      continue;
+    }
+
+    const auto dts = inputPacket->dts != AV_NOPTS_VALUE ? inputPacket->dts
+                                                        : inputPacket->pts;
+    if (dts != AV_NOPTS_VALUE && dts >= lastEnd()) {
+      av_packet_unref(inputPacket.get());
+      break;
+    }
+
+    // Frames still inside the decoder precede the keyframe, no window
+    // holds them and the flush may drop them.
+    const auto nextBegin = firstBegin();
+    if (dts != AV_NOPTS_VALUE && dts < nextBegin && nextBegin != seekedTo) {
+      const auto keyframe =
+          av_index_search_timestamp(stream, nextBegin, AVSEEK_FLAG_BACKWARD);
+      const auto* entry =
+          keyframe >= 0 ? avformat_index_get_entry(stream, keyframe) : nullptr;
+      if (entry && entry->timestamp > dts) {
+        av_packet_unref(inputPacket.get());
+        seekedTo = nextBegin;
+        av_seek_frame(formatContext, _decoder->video_index, nextBegin,
+                      AVSEEK_FLAG_BACKWARD);
+        avcodec_flush_buffers(codecContext);
+        continue;
+      }
+    }
+
+    const bool preRoll =
+        inputPacket->pts != AV_NOPTS_VALUE && inputPacket->pts < nextBegin;
+    codecContext->skip_frame = preRoll ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+
+    transcode_video(inputPacket.get(), inputFrame.get(), routeFrame);
+    av_packet_unref(inputPacket.get());
+  }
+
+  codecContext->skip_frame = AVDISCARD_DEFAULT;
+  if (openRoutes())
+    transcode_video(nullptr, inputFrame.get(), routeFrame);
+}
+
+int64_t VideoTranscoder::probe_encode(const std::vector<AVFramePtr>& frames,
+                                      int crf) {
+  TraceScope scope("probe_encode", "transcode");
+  scope.setArg("crf", crf);
+  auto context = create_encoder(crf, true);
+  auto* packet = acquire_packet();
+
+  SizeProjection projection{static_cast<int64_t>(frames.size()),
+                            WebmHeaderBytes, 0};
+  // False once the projection says the encode can not fit.
+  const auto drain = [this, &context, packet, &projection]() {
+    for (;;) {
+      const auto response =
+          timed(_stats.encodeUs, "encode", [&context, packet] {
+            return avcodec_receive_packet(context.get(), packet);
+          });
+      if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+        break;
+      } else if (response < 0) {
+        throw std::runtime_error(ReceivingPacketEncoderException);
+      }
+
+      projection.add(packet->size);
+      av_packet_unref(packet);
+      if (projected_oversize(projection))
+        return false;
+    }
+    return true;
+  };
+
+  for (const auto& frame : frames) {
+    check_cancelled();
+    account_reference(frame.get());
+    if (timed(_stats.encodeUs, "encode", [&context, &frame] {
+          return avcodec_send_frame(context.get(), frame.get());
+        }) < 0) {
+      throw std::runtime_error(SendingFrameEncoderException);
+    }
+    if (!drain())
+      return projection.projected();
+  }
+
+  timed(_stats.encodeUs, "encode",
+        [&context] { return avcodec_send_frame(context.get(), nullptr); });
+  drain();
+
+  return projection.bytes;
+}
+
+int64_t VideoTranscoder::final_encode(const std::vector<AVFramePtr>& frames,
+                                      int crf) {
+  TraceScope scope("final_encode", "transcode");
+  scope.setArg("crf", crf);
+  prepare_output();
+  auto context = create_encoder(crf, false);
+
+  avcodec_parameters_from_context(_encoder->stream->codecpar, context.get());
+  _encoder->stream->time_base = context->time_base;
+
+  if (avformat_write_header(_encoder->formatContext, nullptr) < 0) {
+    throw std::runtime_error(WriteHeaderFileException);
+  }
+
+  auto* packet = acquire_packet();
+  SizeProjection projection{static_cast<int64_t>(frames.size()),
+                            WebmHeaderBytes, 0};
+  // False once the projection says the encode can not fit.
+  const auto drain = [this, &context, packet, &projection]() {
+    for (;;) {
+      const auto response =
+          timed(_stats.encodeUs, "encode", [&context, packet] {
+            return avcodec_receive_packet(context.get(), packet);
+          });
+      if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+        break;
+      } else if (response < 0) {
+        throw std::runtime_error(ReceivingPacketEncoderException);
+      }
+
+      projection.add(packet->size);
+      packet->stream_index = _encoder->stream->index;
+      av_packet_rescale_ts(packet, context->time_base,
+                           _encoder->stream->time_base);
+      if (timed(_stats.muxUs, "mux", [this, packet] {
+            return av_interleaved_write_frame(_encoder->formatContext, packet);
+          }) != 0) {
+        throw std::runtime_error(WritePacketException);
+      }
+      if (projected_oversize(projection))
+        return false;
+    }
+    return true;
+  };
+
+  for (const auto& frame : frames) {
+    check_cancelled();
+    account_reference(frame.get());
+    if (timed(_stats.encodeUs, "encode", [&context, &frame] {
+          return avcodec_send_frame(context.get(), frame.get());
+        }) < 0) {
+      throw std::runtime_error(SendingFrameEncoderException);
+    }
+    if (!drain()) {
+      // Freed without a trailer, the caller moves on to a higher crf.
+      close_output();
+      return projection.projected();
+    }
+  }
+
+  timed(_stats.encodeUs, "encode",
+        [&context] { return avcodec_send_frame(context.get(), nullptr); });
+  drain();
+
+  av_write_trailer(_encoder->formatContext);
+  const auto size = _output.size();
+  close_output();
+
+  return size;
+}
+
+void VideoTranscoder::prepare_decoder(int codecs) {
+  auto* formatContext = _decoder->formatContext;
+  const auto index = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1,
+                                         -1, nullptr, 0);
+  if (index < 0) {
+    throw std::runtime_error(FindVideoStreamException);
+  }
+
+  // The demuxer drops packets of every other stream before they reach us.
+  for (unsigned int i = 0; i < formatContext->nb_streams; ++i) {
+    formatContext->streams[i]->discard =
+        static_cast<int>(i) == index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
+
+  _decoder->stream = formatContext->streams[index];
+  _decoder->video_index = index;
+
+  if (_budget) {
+    const auto* codecpar = _decoder->stream->codecpar;
+    auto wanted = std::max(
+        codecpar->width * codecpar->height / PixelsPerDecoderThread, 1);
+    if (_settings.maxThreadsPerJob > 0)
+      wanted = std::min(wanted, _settings.maxThreadsPerJob);
+    // One lease covers every codec running at once, each gets an equal
+    // part and at least a thread.
+    _threads = _budget->acquire(wanted * codecs, _expectedJobs, codecs);
+    _threadCount = std::max(_threads.getThreads() / codecs, 1);
+  }
+
+  fill_stream_info(_decoder->stream, &_decoder->codec,
+                   &_decoder->codecContext);
+}
+
+void VideoTranscoder::prepare_video_encoder() {
+  prepare_output();
+
+  _encoder->codecContext = create_encoder(-1, false).release();
+  _encoder->stream->time_base = _encoder->codecContext->time_base;
+  avcodec_parameters_from_context(_encoder->stream->codecpar,
+                                  _encoder->codecContext);
+}
+
+void VideoTranscoder::prepare_output() {
+  avformat_alloc_output_context2(&_encoder->formatContext, nullptr, nullptr,
+                                 _encoder->filename.c_str());
+  if (!_encoder->formatContext) {
+    throw std::runtime_error(AllocateOutputFormatException);
+  }
+
+  _encoder->stream = avformat_new_stream(_encoder->formatContext, nullptr);
+
+  // Muxed into memory, the file is only written once the size is known to
+  // fit, see MemoryOutput::commit.
+  _output.reset();
+  _encoder->formatContext->pb = _output.context();
+  _encoder->formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+}
+
+void VideoTranscoder::close_output() {
+  auto*& formatContext = _encoder->formatContext;
+  if (!formatContext)
+    return;
+
+  avformat_free_context(formatContext);
+  formatContext = nullptr;
+  _encoder->stream = nullptr;
+}
+
+AVCodecContextPtr VideoTranscoder::create_encoder(int crf, bool probe) {
+  auto context = AVCodecContextPtr(avcodec_alloc_context3(_encoder->codec));
+  if (!context) {
+    throw std::runtime_error(AllocateCodecContextException);
+  }
+
+  const bool isVpx = context->codec_id == AV_CODEC_ID_VP8 ||
+                     context->codec_id == AV_CODEC_ID_VP9;
+  if (context->codec_id == AV_CODEC_ID_H264)
+    av_opt_set(context->priv_data, "preset", "slow", 0);
+  else if (!isVpx)
+    av_opt_set(context->priv_data, "preset", "fast", 0);
+
+  // Tiles split the frame into columns, row-mt splits each column into
+  // superblock rows. More threads than that have nothing to work on.
+  int tileColumnsLog2 = 0;
+  while ((2 << tileColumnsLog2) <= _threadCount &&
+         (2 << tileColumnsLog2) * MinTileWidth <= _settings.width) {
+    ++tileColumnsLog2;
+  }
+  const int superblockRows =
+      (_settings.height + SuperblockSize - 1) / SuperblockSize;
+  context->thread_count = std::min(_threadCount,
+                                   (1 << tileColumnsLog2) * superblockRows);
+
+  if (isVpx) {
+    av_opt_set_int(context->priv_data, "row-mt", 1, 0);
+    av_opt_set_int(context->priv_data, "tile-columns", tileColumnsLog2, 0);
+    av_opt_set_int(context->priv_data, "cpu-used",
+                   probe ? ProbeCpuUsed : _settings.cpuUsed, 0);
+  }
+
+  context->height = _settings.height;
+  context->width = _settings.width;
+  context->sample_aspect_ratio = {_settings.width, _settings.height};
+  context->pix_fmt = _pixFormat;
+  context->max_b_frames = _source->codecContext->max_b_frames;
+  context->time_base = av_inv_q(_frameRate);
+  context->framerate = _frameRate;
+
+  if (crf < 0) {
+    const int64_t maxBitrate =
+        _settings.maxFileSizeByte / (_settings.maxDurationMs / 1000.0) - 1;
+
+    context->bit_rate = std::min(maxBitrate, _source->codecContext->bit_rate);
+    context->rc_buffer_size = _settings.maxFileSizeByte;
+    context->rc_max_rate =
+        std::min(maxBitrate, _source->codecContext->rc_max_rate);
+    context->rc_min_rate =
+        std::min(maxBitrate, _source->codecContext->rc_min_rate);
+  } else {
+    // Constrained quality: crf picks the quality, bit_rate caps it.
+    context->bit_rate = _bitRate;
+    av_opt_set_int(context->priv_data, "crf", crf, 0);
+    av_opt_set(context->priv_data, "deadline",
+               probe ? ProbeDeadline : FinalDeadline, 0);
+  }
+
+  if (!probe && _encoder->formatContext &&
+      (_encoder->formatContext->oformat->flags & AVFMT_GLOBALHEADER))
+    context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+  if (avcodec_open2(context.get(), _encoder->codec, nullptr) < 0) {
+    throw std::runtime_error(OpenCodecException);
+  }
+
+  return context;
+}
+
+void VideoTranscoder::fill_stream_info(AVStream* avs,
+                                       AVCodec** avc,
+                                       AVCodecContext** avcc) {
+  *avc = const_cast<AVCodec*>(avcodec_find_decoder(avs->codecpar->codec_id));
+  if (!*avc) {
+    throw std::runtime_error(FindCodecException);
+  }
+
+  *avcc = avcodec_alloc_context3(*avc);
+  if (!*avcc) {
+    throw std::runtime_error(AllocateCodecContextException);
+  }
+
+  if (avcodec_parameters_to_context(*avcc, avs->codecpar) < 0) {
+    throw std::runtime_error(FillCodecContextException);
+  }
+
+  (*avcc)->thread_count = _threadCount;
+  (*avcc)->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+  if (avcodec_open2(*avcc, *avc, nullptr) < 0) {
+    throw std::runtime_error(OpenCodecException);
+  }
+}
+
+void VideoTranscoder::open_media() {
+  const TraceScope scope("open_media", "demux");
+  auto** avfc = &_decoder->formatContext;
+  *avfc = avformat_alloc_context();
+  if (!*avfc) {
+    throw std::runtime_error(AllocateAVFormatContextException);
+  }
+
+  if (avformat_open_input(avfc, _decoder->filename.c_str(), nullptr,
+                          nullptr) != 0) {
+    throw std::runtime_error(OpenInputFileException);
+  }
+
+  if (avformat_find_stream_info(*avfc, nullptr) < 0) {
+    throw std::runtime_error(FindStreamInfoException);
+  }
+}
+
+AVFramePtr VideoTranscoder::scale_frame(AVFrame* inputFrame,
+                                        SwsContext* scale) {
+  auto scaledFrame = _framePool.acquire();
+  scaledFrame->pts = inputFrame->pts;
+  scaledFrame->pict_type = AV_PICTURE_TYPE_NONE;
+
+  // Frames that changed size or format midstream fall back to swscale.
+  const auto* codecContext = _source->codecContext;
+  if (_areaScaler && inputFrame->format == codecContext->pix_fmt &&
+      inputFrame->width == codecContext->width &&
+      inputFrame->height == codecContext->height) {
+    timed(_stats.scaleUs, "area_scale", [this, inputFrame, &scaledFrame] {
+      _areaScaler->scale(inputFrame, scaledFrame.get());
+    });
+  } else {
+    if (inputFrame->format != codecContext->pix_fmt ||
+        inputFrame->width != codecContext->width ||
+        inputFrame->height != codecContext->height) {
+      _midstreamScale.reset(sws_getCachedContext(
+          _midstreamScale.release(), inputFrame->width, inputFrame->height,
+          static_cast<AVPixelFormat>(inputFrame->format), _settings.width,
+          _settings.height, _pixFormat, SWS_SPLINE, nullptr, nullptr,
+          nullptr));
+      scale = _midstreamScale.get();
+    }
+    if (!scale) {
+      throw std::runtime_error(AllocateScaleContextException);
+    }
+    timed(_stats.scaleUs, "sws_scale", [scale, inputFrame, &scaledFrame] {
+      return sws_scale(scale, inputFrame->data, inputFrame->linesize, 0,
+                       inputFrame->height, scaledFrame->data,
+                       scaledFrame->linesize);
+    });
+  }
+  ++_stats.scaledFrames;
+
+  return scaledFrame;
+}
+
+void VideoTranscoder::encode_video(AVFrame* scaledFrame) {
+  auto* output_packet = acquire_packet();
+
+  auto* codecContext = _encoder->codecContext;
+  account_reference(scaledFrame);
+  int response = timed(_stats.encodeUs, "encode", [codecContext, scaledFrame] {
+    return avcodec_send_frame(codecContext, scaledFrame);
+  });
+  while (response >= 0) {
+    response = timed(_stats.encodeUs, "encode", [codecContext, output_packet] {
+      return avcodec_receive_packet(codecContext, output_packet);
+    });
+    if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+      break;
+    } else if (response < 0) {
+      throw std::runtime_error(ReceivingPacketDecoderException);
+    }
+
+    _streamProjection.add(output_packet->size);
+    // Frames carry their output index, the encoder stamps packets with it.
+    output_packet->stream_index = _encoder->stream->index;
+    av_packet_rescale_ts(output_packet, codecContext->time_base,
+                         _encoder->stream->time_base);
+
+    response = timed(_stats.muxUs, "mux", [this, output_packet] {
+      return av_interleaved_write_frame(_encoder->formatContext, output_packet);
+    });
+    if (response != 0) {
+      throw std::runtime_error(ReceivingPacketDecoderException);
+    }
+
+    if (projected_oversize(_streamProjection)) {
+      av_packet_unref(output_packet);
+      throw std::runtime_error(OversizedOutputException);
+    }
+  }
+  av_packet_unref(output_packet);
+}
+
+AVPacket* VideoTranscoder::acquire_packet() {
+  if (!_packet) {
+    _packet = AVPacketPtr(av_packet_alloc());
+    if (!_packet) {
+      throw std::runtime_error(AllocateAVPacketException);
+    }
+    ++_stats.packetAllocations;
+  }
+  return _packet.get();
+}
+
+void VideoTranscoder::transcode_video(AVPacket* input_packet,
+                                      AVFrame* input_frame,
+                                      const FrameSink& sink) {
+  auto* codecContext = _decoder->codecContext;
+  int response = timed(_stats.decodeUs, "decode", [codecContext, input_packet] {
+    return avcodec_send_packet(codecContext, input_packet);
+  });
+  if (response < 0) {
+    throw std::runtime_error(SendongPacketDecoderException);
+  }
+
+  while (response >= 0) {
+    response = timed(_stats.decodeUs, "decode", [codecContext, input_frame] {
+      return avcodec_receive_frame(codecContext, input_frame);
+    });
+    if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+      break;
+    } else if (response < 0) {
+      throw std::runtime_error(ReceivingFrameDecoderException);
+    }
+
+    if (response >= 0) {
+      ++_stats.decodedFrames;
+      sink(input_frame);
+    }
+    av_frame_unref(input_frame);
+  }
+}
+
+void VideoTranscoder::account_reference(const AVFrame* frame) {
+  if (!frame || frame->buf[0])
+    return;
+
+  ++_copiedFrames;
+  _copiedBytes += av_image_get_buffer_size(
+      static_cast<AVPixelFormat>(frame->format), frame->width, frame->height,
+      1);
+}
+
+void VideoTranscoder::check_cancelled() const {
+  if (_cancelled && *_cancelled) {
+    throw std::runtime_error(CancelledException);
+  }
+}
+
+int64_t VideoTranscoder::budget_bitrate(const VideoProp& input) const {
+  const auto durationMs = std::clamp<int64_t>(
+      input.endPosMs - input.beginPosMs, 1, _settings.maxDurationMs);
+  return _settings.maxFileSizeByte * 8 * 1000 / durationMs;
+}
+
+int64_t VideoTranscoder::expected_frames(const VideoProp& input) const {
+  const auto durationMs = std::clamp<int64_t>(
+      input.endPosMs - input.beginPosMs, 1, _settings.maxDurationMs);
+  return std::max<int64_t>(
+      av_rescale_q(durationMs, MsTimeBase, av_inv_q(_frameRate)), 1);
+}
+
+bool VideoTranscoder::projected_oversize(const SizeProjection& projection) {
+  if (_settings.earlyAbortMargin < 0 ||
+      projection.packets < projection.expectedFrames * MinProjectedShare) {
+    return false;
+  }
+
+  const auto projected = projection.projected();
+  if (projected <=
+      _settings.maxFileSizeByte * (1 + _settings.earlyAbortMargin)) {
+    return false;
+  }
+
+  qDebug() << "projected" << projected << "bytes after" << projection.packets
+           << "of" << projection.expectedFrames << "frames, limit is"
+           << _settings.maxFileSizeByte;
+  ++_stats.earlyAborts;
+  return true;
+}
+
+void VideoTranscoder::SizeProjection::add(int64_t packetBytes) {
+  bytes += packetBytes + WebmBytesPerFrame;
+  ++packets;
+}
+
+int64_t VideoTranscoder::SizeProjection::projected() const {
+  if (packets == 0)
+    return bytes;
+  return bytes * std::max(expectedFrames, packets) / packets;
+}
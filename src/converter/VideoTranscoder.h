@@ -0,0 +1,189 @@
+#ifndef VIDEOTRANSCODER_H
+#define VIDEOTRANSCODER_H
+
+#include <QObject>
+#include <QUuid>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AreaScaler.h"
+#include "EncoderSettings.h"
+#include "FrameFeed.h"
+#include "FramePool.h"
+#include "MemoryOutput.h"
+#include "StreamingContext.h"
+#include "ToWebmConvertor.h"
+#include "utility/ThreadBudget.h"
+
+struct TranscodeStats {
+  int64_t decodedFrames = 0;
+  int64_t scaledFrames = 0;
+  // Decoded inside the window but over the output frame rate cap.
+  int64_t droppedFrames = 0;
+
+  // Wall time spent inside each stage, summed over the threads running it.
+  int64_t demuxUs = 0;
+  int64_t decodeUs = 0;
+  int64_t scaleUs = 0;
+  int64_t encodeUs = 0;
+  int64_t muxUs = 0;
+
+  // A warmed-up transcoder should stop growing these no matter how many
+  // frames it processes.
+  int64_t frameAllocations = 0;
+  int64_t bufferAllocations = 0;
+  int64_t packetAllocations = 0;
+  // Frame data FFmpeg copied on the way to an encoder or a queue, because
+  // the frame had no reference counted buffer. Pooled frames never do.
+  int64_t copiedFrames = 0;
+  int64_t copiedBytes = 0;
+
+  // Encodes stopped because their projected size blew the budget.
+  int64_t earlyAborts = 0;
+};
+
+class VideoTranscoder : public QObject {
+  Q_OBJECT
+  using FrameSink = std::function<void(AVFrame*)>;
+  using ScaledFrameSink = std::function<void(AVFramePtr)>;
+
+ signals:
+  void updateProgress(QUuid taskId, int progress);
+
+ public:
+  // One output of a fan-out: a window of the source encoded with its own
+  // settings into encoder->filename.
+  struct Branch {
+    VideoProp input;
+    EncoderSettings settings;
+    ContextPtr encoder;
+  };
+  using BranchProgress = std::function<void(size_t index, int progress)>;
+  // Called once per branch from the thread it ran on, error is null when
+  // the output was written.
+  using BranchDone =
+      std::function<void(size_t index, std::exception_ptr error)>;
+
+  VideoTranscoder(ContextPtr encoder,
+                  ContextPtr decoder,
+                  EncoderSettings settings = {},
+                  const std::atomic_bool* cancelled = nullptr);
+
+  // Decoder and encoder threads are leased from budget once the source
+  // size is known. Without a budget both run on a single thread.
+  void setThreadBudget(ThreadBudget* budget, int expectedJobs);
+  void process(const VideoProp& input);
+  // Decodes the source once and hands every branch the frames of its
+  // window, windows may overlap or lie far apart. Branches scale and
+  // encode on threads of their own and fail on their own. The stats of
+  // all branches add up into this transcoder's.
+  void processBranches(std::vector<Branch> branches,
+                       const BranchProgress& progress,
+                       const BranchDone& done);
+  TranscodeStats getStats() const;
+
+ private:
+  // Output bytes so far against frames encoded, projected over the window
+  // assuming the remaining frames cost the same on average.
+  struct SizeProjection {
+    int64_t expectedFrames = 0;
+    int64_t bytes = 0;
+    int64_t packets = 0;
+
+    void add(int64_t packetBytes);
+    int64_t projected() const;
+  };
+
+  // Everything after the source is open, frames come from _decoder or
+  // from _feed.
+  void transcode_window(const VideoProp& input);
+  // Decode side of processBranches.
+  void decode_branches(const std::vector<VideoProp>& inputs,
+                       const std::vector<EncoderSettings>& settings,
+                       std::vector<std::unique_ptr<FrameFeed>>& feeds);
+  void process_streaming(const VideoProp& input, SwsContext* scale);
+  void process_size_targeted(const VideoProp& input, SwsContext* scale);
+
+  void read_window(const VideoProp& input,
+                   const FrameSink& sink,
+                   int progressBegin,
+                   int progressEnd);
+  void read_scaled_window(const VideoProp& input,
+                          SwsContext* scale,
+                          const ScaledFrameSink& sink,
+                          int progressBegin,
+                          int progressEnd);
+  void read_window_pipelined(const VideoProp& input,
+                             SwsContext* scale,
+                             const ScaledFrameSink& sink,
+                             int progressBegin,
+                             int progressEnd);
+  int64_t probe_encode(const std::vector<AVFramePtr>& frames, int crf);
+  int64_t final_encode(const std::vector<AVFramePtr>& frames, int crf);
+
+  // Leases threads for codecs running side by side. A lone job counts
+  // one, its decoder and encoder share the lease.
+  void prepare_decoder(int codecs = 1);
+  void prepare_video_encoder();
+  void prepare_output();
+  void close_output();
+  AVCodecContextPtr create_encoder(int crf, bool probe);
+  void fill_stream_info(AVStream* avs, AVCodec** avc, AVCodecContext** avcc);
+  void open_media();
+  AVFramePtr scale_frame(AVFrame* inputFrame, SwsContext* scale);
+  void encode_video(AVFrame* scaledFrame);
+  AVPacket* acquire_packet();
+  void transcode_video(AVPacket* input_packet,
+                       AVFrame* input_frame,
+                       const FrameSink& sink);
+  // Counts the copy av_frame_ref and avcodec_send_frame make of a frame
+  // without a reference counted buffer.
+  void account_reference(const AVFrame* frame);
+  void check_cancelled() const;
+  int64_t budget_bitrate(const VideoProp& input) const;
+  int64_t expected_frames(const VideoProp& input) const;
+  // Counts the early abort when it says yes.
+  bool projected_oversize(const SizeProjection& projection);
+
+  // Declared first so the lease outlives the codec threads it accounts for.
+  ThreadBudget* _budget = nullptr;
+  int _expectedJobs = 1;
+  ThreadBudget::Lease _threads;
+  // Threads per codec, the lease's or the part of the fan-out parent's
+  // lease each branch gets.
+  int _threadCount = 1;
+  // Declared before _encoder, its muxer writes here until it is freed.
+  MemoryOutput _output;
+  ContextPtr _encoder = nullptr;
+  ContextPtr _decoder = nullptr;
+  // Source properties are read through here, _decoder itself or the
+  // decoder of the fan-out this transcoder is a branch of.
+  StreamingContext* _source = nullptr;
+  // Frames of the shared decode for a branch, null when decoding itself.
+  FrameFeed* _feed = nullptr;
+  EncoderSettings _settings;
+  // Output frame rate, the source rate capped at maxOutputFps. Frames leave
+  // read_window with their pts counted in 1 / _frameRate from the window.
+  AVRational _frameRate = {};
+  AVPixelFormat _pixFormat = AV_PIX_FMT_NONE;
+  int64_t _bitRate = 0;
+  SizeProjection _streamProjection;
+  FramePool _framePool;
+  std::unique_ptr<AreaScaler> _areaScaler;
+  // For frames that changed size or format midstream, the context passed
+  // to scale_frame is sized for the decoder's.
+  SwsContextPtr _midstreamScale;
+  AVPacketPtr _packet = nullptr;
+  TranscodeStats _stats;
+  // Counted on the decode and the writer thread of a pipelined window,
+  // added to _stats by getStats.
+  std::atomic<int64_t> _copiedFrames = 0;
+  std::atomic<int64_t> _copiedBytes = 0;
+  const std::atomic_bool* _cancelled = nullptr;
+};
+
+#endif  // VIDEOTRANSCODER_H
@@ -3,14 +3,18 @@
 #include <QDebug>
 #include <QHBoxLayout>
 #include <QLabel>
+#include <QPixmap>
+#include <QSlider>
 #include <QSpinBox >
 #include <QString>
 #include <QVBoxLayout>
 
+#include "PreviewLoader.h"
 #include "utility/StyleSheetUtility.h"
 
 namespace {
 constexpr QSize MinSliderSize(100, 30);
+constexpr QSize PreviewSize(192, 108);
 constexpr auto InputSliderWidgetStyle = ":/styles/InputSliderWidgetStyle.css";
 constexpr auto LabelMaxText = "End position in ms";
 constexpr auto LabelMinText = "Begin position in ms";
@@ -18,12 +22,15 @@ constexpr auto SpinBoxMaxObjectName = "SpinBoxMax";
 constexpr auto SpinBoxMinObjectName = "SpinBoxMin";
 constexpr auto LabelMaxObjectName = "LabelMax";
 constexpr auto LabelMinObjectName = "LabelMin";
+constexpr auto SliderBeginObjectName = "SliderBegin";
+constexpr auto PreviewObjectName = "Preview";
 }  // namespace
 
 InputSliderWidget::InputSliderWidget(QWidget* parent) : QWidget{parent} {
   setStyleSheet(loadStyleSheet(InputSliderWidgetStyle));
 
   auto* mainLayout = new QHBoxLayout(this);
+  auto* previewLayout = new QVBoxLayout();
   auto* sliderLayout = new QVBoxLayout();
   auto* maxLayout = new QVBoxLayout();
   auto* minLayout = new QVBoxLayout();
@@ -35,11 +42,17 @@ InputSliderWidget::InputSliderWidget(QWidget* parent) : QWidget{parent} {
   spinBoxMin = createWidget<QSpinBox>(this, SpinBoxMinObjectName);
   auto* labelMax = createWidget<QLabel>(this, LabelMaxObjectName);
   auto* labelMin = createWidget<QLabel>(this, LabelMinObjectName);
+  sliderBegin = createWidget<QSlider>(this, SliderBeginObjectName);
+  preview = createWidget<QLabel>(this, PreviewObjectName);
+  previewLoader = new PreviewLoader(PreviewSize, this);
 
   labelMax->setText(LabelMaxText);
   labelMin->setText(LabelMinText);
   spinBoxMax->setMinimumSize(MinSliderSize);
   spinBoxMin->setMinimumSize(MinSliderSize);
+  sliderBegin->setOrientation(Qt::Horizontal);
+  preview->setFixedSize(PreviewSize);
+  preview->setAlignment(Qt::AlignCenter);
 
   maxLayout->addWidget(labelMax);
   maxLayout->addWidget(spinBoxMax);
@@ -50,12 +63,40 @@ InputSliderWidget::InputSliderWidget(QWidget* parent) : QWidget{parent} {
   sliderLayout->addLayout(maxLayout);
   sliderLayout->addLayout(minLayout);
 
+  previewLayout->addWidget(preview);
+  previewLayout->addWidget(sliderBegin);
+
+  mainLayout->addLayout(previewLayout);
   mainLayout->addLayout(sliderLayout);
+
+  // The slider scrubs the begin position, either spin box previews the
+  // position it is set to.
+  QObject::connect(sliderBegin, &QSlider::valueChanged, spinBoxMin,
+                   &QSpinBox::setValue);
+  QObject::connect(spinBoxMin, qOverload<int>(&QSpinBox::valueChanged), this,
+                   [this](int value) {
+                     sliderBegin->setValue(value);
+                     previewLoader->request(value);
+                   });
+  QObject::connect(spinBoxMax, qOverload<int>(&QSpinBox::valueChanged),
+                   previewLoader, &PreviewLoader::request);
+  QObject::connect(previewLoader, &PreviewLoader::previewReady, preview,
+                   [this](qint64, const QImage& image) {
+                     preview->setPixmap(QPixmap::fromImage(image));
+                   });
 }
 
 void InputSliderWidget::setLimit(int max) {
   spinBoxMax->setRange(0, max);
   spinBoxMin->setRange(0, max);
+  sliderBegin->setRange(0, max);
+}
+
+void InputSliderWidget::setFile(const QString& fileName) {
+  preview->clear();
+  previewLoader->setFile(fileName);
+  if (!fileName.isEmpty())
+    previewLoader->request(getBegin());
 }
 
 void InputSliderWidget::setBegin(int value) {
@@ -1,8 +1,12 @@
 #ifndef INPUTSLIDERWIDGET_H
 #define INPUTSLIDERWIDGET_H
 
+#include <QString>
 #include <QWidget>
 
+class PreviewLoader;
+class QLabel;
+class QSlider;
 class QSpinBox;
 
 class InputSliderWidget : public QWidget {
@@ -10,6 +14,9 @@ class InputSliderWidget : public QWidget {
  public:
   explicit InputSliderWidget(QWidget* parent = nullptr);
   void setLimit(int max);
+  // Video the positions belong to, previewed at the edited position. An
+  // empty name clears the preview.
+  void setFile(const QString& fileName);
 
   void setBegin(int value);
   void setEnd(int value);
@@ -20,6 +27,9 @@ class InputSliderWidget : public QWidget {
  private:
   QSpinBox* spinBoxMax = nullptr;
   QSpinBox* spinBoxMin = nullptr;
+  QSlider* sliderBegin = nullptr;
+  QLabel* preview = nullptr;
+  PreviewLoader* previewLoader = nullptr;
 };
 
 #endif  // INPUTSLIDERWIDGET_H
@@ -0,0 +1,113 @@
+#include "PreviewLoader.h"
+
+#include <QElapsedTimer>
+#include <QMetaObject>
+#include <utility>
+#include <vector>
+
+#include "utility/FrameGrabber.h"
+#include "utility/MediaProbe.h"
+
+PreviewLoader::PreviewLoader(QSize size, QObject* parent)
+    : QObject(parent), size(size), pool(1) {}
+
+PreviewLoader::~PreviewLoader() {
+  ++generation;
+  pool.stop();
+}
+
+void PreviewLoader::setFile(const QString& fileName) {
+  std::lock_guard lock(mutex);
+  this->fileName = fileName;
+  positionMs = -1;
+  ++generation;
+}
+
+void PreviewLoader::request(int64_t positionMs) {
+  {
+    std::lock_guard lock(mutex);
+    this->positionMs = positionMs;
+    ++generation;
+    if (scheduled)
+      return;
+    scheduled = true;
+  }
+  pool.push([this] { decodeLatest(); });
+}
+
+void PreviewLoader::decodeLatest() {
+  QString file;
+  int64_t position = 0;
+  uint64_t current = 0;
+  {
+    std::lock_guard lock(mutex);
+    scheduled = false;
+    file = fileName;
+    position = positionMs;
+    current = generation;
+  }
+  if (file.isEmpty() || position < 0)
+    return;
+
+  if (file != openedFileName)
+    open(file);
+  if (!grabber->isOpen())
+    return;
+  if (!indexed)
+    loadIndex();
+
+  QElapsedTimer timer;
+  timer.start();
+  QImage closest;
+  auto quickSent = false;
+  const auto image =
+      grabber->frameAt(position, size, [&](const QImage& decoded) {
+        if (!decoded.isNull())
+          closest = decoded;
+        if (!quickSent && !closest.isNull() &&
+            timer.elapsed() >= QuickPreviewMs) {
+          deliver(file, position, closest);
+          quickSent = true;
+        }
+        return generation == current;
+      });
+  if (!image.isNull() && generation == current)
+    deliver(file, position, image);
+}
+
+void PreviewLoader::open(const QString& fileName) {
+  grabber = std::make_unique<FrameGrabber>(fileName);
+  openedFileName = fileName;
+  indexed = false;
+}
+
+void PreviewLoader::loadIndex() {
+  // Looked up only, the list builds the index while it probes the file.
+  // Until then the grabber seeks through the container.
+  const auto info = MediaProbe::shared().cached(openedFileName);
+  if (!info || info->keyframesMs.empty())
+    return;
+  indexed = true;
+  std::vector<FrameGrabber::SeekPoint> index;
+  index.reserve(info->keyframesMs.size());
+  for (size_t i = 0; i < info->keyframesMs.size(); ++i)
+    index.push_back({info->keyframesMs[i], info->keyframeOffsets[i]});
+  grabber->setSeekIndex(std::move(index));
+}
+
+void PreviewLoader::deliver(const QString& fileName,
+                            int64_t positionMs,
+                            const QImage& image) {
+  QMetaObject::invokeMethod(
+      this,
+      [this, fileName, positionMs, image] {
+        // A slow decode may finish after the next request was made.
+        {
+          std::lock_guard lock(mutex);
+          if (fileName != this->fileName || positionMs != this->positionMs)
+            return;
+        }
+        emit previewReady(positionMs, image);
+      },
+      Qt::QueuedConnection);
+}
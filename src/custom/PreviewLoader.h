@@ -0,0 +1,70 @@
+#ifndef PREVIEWLOADER_H
+#define PREVIEWLOADER_H
+
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "utility/ThreadPool.h"
+
+class FrameGrabber;
+
+// Decodes trim previews of one file on a thread of its own. Only the
+// newest request counts, a decode running for an older one gives up and
+// frames of older requests are dropped. The keyframe index is looked up
+// in the media probe cache, so each request seeks straight to the keyframe
+// before it.
+class PreviewLoader : public QObject {
+  Q_OBJECT
+ public:
+  explicit PreviewLoader(QSize size, QObject* parent = nullptr);
+  ~PreviewLoader() override;
+
+  // An empty name closes the current file.
+  void setFile(const QString& fileName);
+  // previewReady follows with the frame at positionMs. When that takes
+  // longer than QuickPreviewMs, the closest frame decoded so far goes out
+  // first.
+  void request(int64_t positionMs);
+
+  static constexpr int64_t QuickPreviewMs = 30;
+
+ signals:
+  void previewReady(qint64 positionMs, const QImage& image);
+
+ private:
+  // Pool side, decodes the newest request.
+  void decodeLatest();
+  void open(const QString& fileName);
+  // Hands the grabber the keyframe index once the probe cache has it.
+  void loadIndex();
+  // Emits previewReady unless a newer request came in meanwhile.
+  void deliver(const QString& fileName,
+               int64_t positionMs,
+               const QImage& image);
+
+  const QSize size;
+
+  std::mutex mutex;
+  QString fileName;
+  int64_t positionMs = -1;
+  bool scheduled = false;
+  // Bumped by every request and file change.
+  std::atomic<uint64_t> generation{0};
+
+  // Pool side only.
+  std::unique_ptr<FrameGrabber> grabber;
+  QString openedFileName;
+  bool indexed = false;
+
+  // Last member, so a running decode finishes before the state it uses is
+  // destroyed.
+  ThreadPool pool;
+};
+
+#endif  // PREVIEWLOADER_H
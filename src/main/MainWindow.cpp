@@ -1,5 +1,6 @@
 #include "MainWindow.h"
 
+#include <QAction>
 #include <QDebug>
 #include <QFileDialog>
 #include <QHBoxLayout>
@@ -7,10 +8,12 @@
 #include <QLabel>
 #include <QLayout>
 #include <QListView>
+#include <QMessageBox>
 #include <QPushButton>
 #include <QScreen>
 #include <QSettings>
 #include <QStandardPaths>
+#include <QStatusBar>
 #include <QStyledItemDelegate>
 #include <QVBoxLayout>
 #include <algorithm>
@@ -30,11 +33,22 @@ constexpr QSize OperationWidgetMinSize(300, 300);
 constexpr QSize FilesListMinSize(500, 300);
 constexpr auto ConvertButtonText = "Convert";
 constexpr auto SelectPathButtonText = "Select output path";
+constexpr auto PinActionText = "Convert first / normal order";
 constexpr auto OutPathLabelObjectName = "OutPathLabel";
 constexpr auto Organization = "AiDecay";
 constexpr auto Application = "TgCreateEmoji";
 constexpr auto OutputPathKey = "OutputPath";
 constexpr auto WindowIcon = ":/images/Resources/AppIcon/icon.ico";
+constexpr auto ProbeFailedMessage = "Skipped %1 file(s) that are not video: %2";
+constexpr auto StatusMessageTimeoutMs = 10000;
+constexpr auto JournalFileName = "/batch-journal.jsonl";
+constexpr auto ResumedMessage = "Resumed %1 unfinished conversion(s)";
+constexpr auto ResumeTitle = "Unfinished conversions";
+constexpr auto ResumeQuestion =
+    "The last session ended with %1 conversion(s) unfinished. Resume them?";
+constexpr auto AbandonedMessage =
+    "Gave up on %1 conversion(s) that were running each time the app "
+    "stopped: %2";
 }  // namespace
 
 MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
@@ -77,8 +91,9 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
 
   operationLayout->setAlignment(Qt::AlignmentFlag::AlignTop);
 
+  auto* model = new ConvertItemListModel();
   files = new QListView(this);
-  files->setModel(new ConvertItemListModel());
+  files->setModel(model);
   files->setSelectionMode(QAbstractItemView::SingleSelection);
   files->setDragEnabled(true);
   files->viewport()->setAcceptDrops(true);
@@ -87,6 +102,20 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
   files->setItemDelegate(new ConvertItemDelegate(files));
   files->setMinimumSize(FilesListMinSize);
 
+  // Pinned items start before the rest, whatever their estimated cost.
+  auto* pinAction = new QAction(PinActionText, files);
+  files->setContextMenuPolicy(Qt::ActionsContextMenu);
+  files->addAction(pinAction);
+  QObject::connect(pinAction, &QAction::triggered, files, [this]() {
+    const auto index = files->currentIndex();
+    if (!index.isValid())
+      return;
+    const auto pinned =
+        index.data(ConvertItemListModel::Roles::Priority).toInt() > 0;
+    files->model()->setData(index, pinned ? 0 : 1,
+                            ConvertItemListModel::Roles::Priority);
+  });
+
   QObject::connect(
       selectPathButton, &QPushButton::clicked, outPathLabel,
       [outPathLabel, this]() {
@@ -116,6 +145,8 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
         QModelIndex index;
         for (int i = 0; i < count; ++i) {
           index = files->model()->index(i, 0);
+          if (index.data(ConvertItemListModel::Roles::Probing).toBool())
+            continue;
           const auto begin =
               index.data(ConvertItemListModel::Roles::BeginPos).toInt();
           auto end = index.data(ConvertItemListModel::Roles::EndPos).toInt();
@@ -131,6 +162,7 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
               index.data(Qt::DisplayRole).toString(),
               begin,
               end,
+              index.data(ConvertItemListModel::Roles::Priority).toInt(),
           });
         }
 
@@ -139,22 +171,36 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
       });
 
   QObject::connect(
-      convertor, &ToWebmConvertor::updateProgress, files,
-      [convertButton, this](QUuid uuid, int value) {
-        if (auto* model = qobject_cast<ConvertItemListModel*>(files->model())) {
-          const auto index = model->getIndexForUuid(uuid);
-          model->setData(index, value, ConvertItemListModel::Roles::Progress);
-          if (value == 100 || value == -1) {
-            session[uuid] = true;
-            const auto isAllReady =
-                std::all_of(session.begin(), session.end(),
-                            [](const auto isReady) { return isReady; });
-            if (isAllReady) {
-              model->removeRows(0, session.size());
-              convertButton->setEnabled(true);
-            }
+      convertor, &ToWebmConvertor::progressChanged, files,
+      [convertButton, model, this](const std::vector<ProgressUpdate>& updates) {
+        model->updateProgress(updates);
+
+        auto anyFinished = false;
+        for (const auto& update : updates) {
+          if (update.progress == 100 || update.progress == -1) {
+            session[update.uuid] = true;
+            anyFinished = true;
           }
         }
+
+        const auto isAllReady =
+            std::all_of(session.begin(), session.end(),
+                        [](const auto isReady) { return isReady; });
+        if (anyFinished && isAllReady) {
+          // Rows probed or dropped meanwhile stay, whatever their position.
+          model->removeUuids(session.keys());
+          session.clear();
+          convertButton->setEnabled(true);
+        }
+      });
+
+  QObject::connect(
+      model, &ConvertItemListModel::probeFailed, this,
+      [this](const QStringList& fileNames) {
+        statusBar()->showMessage(QString(ProbeFailedMessage)
+                                     .arg(fileNames.size())
+                                     .arg(fileNames.join(", ")),
+                                 StatusMessageTimeoutMs);
       });
 
   QObject::connect(
@@ -187,12 +233,47 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
             inputWidget->setBegin(begin);
             inputWidget->setEnd(end);
           }
+          inputWidget->setFile(current.data(Qt::DisplayRole).toString());
 
         } else {
           inputWidget->setEnabled(false);
+          inputWidget->setFile(QString());
         }
       });
 
+  // Conversions a crashed session left unfinished start again once the
+  // user agrees. Those that kept crashing the app are not offered.
+  convertor->setJournalFile(
+      QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) +
+      '/' + Application + JournalFileName);
+  QStringList abandoned;
+  for (const auto& prop : convertor->abandoned())
+    abandoned.push_back(prop.path);
+  if (!abandoned.isEmpty()) {
+    statusBar()->showMessage(QString(AbandonedMessage)
+                                 .arg(abandoned.size())
+                                 .arg(abandoned.join(", ")),
+                             StatusMessageTimeoutMs);
+  }
+  const auto unfinished = convertor->unfinished().size();
+  if (unfinished > 0 &&
+      QMessageBox::question(this, ResumeTitle,
+                            QString(ResumeQuestion).arg(unfinished)) !=
+          QMessageBox::Yes) {
+    convertor->discardUnfinished();
+  }
+  const auto resumed = convertor->resume();
+  for (const auto& prop : resumed) {
+    model->addResumed(prop.uuid, prop.path, prop.beginPosMs, prop.endPosMs,
+                      prop.priority);
+    session.insert(prop.uuid, false);
+  }
+  if (!resumed.empty()) {
+    convertButton->setEnabled(false);
+    statusBar()->showMessage(QString(ResumedMessage).arg(resumed.size()),
+                             StatusMessageTimeoutMs);
+  }
+
   central->setLayout(mainLayout);
   setCentralWidget(central);
   gifLayout->addWidget(files);
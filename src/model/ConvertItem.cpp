@@ -9,6 +9,9 @@ ConvertItem::ConvertItem(QString fileName, int64_t durationMs)
   _endPosMs = std::min(static_cast<int64_t>(DefaultEndPos), durationMs);
 }
 
+ConvertItem::ConvertItem(QString fileName)
+    : _probing(true), _fileName(fileName) {}
+
 QString ConvertItem::getFileName() const {
   return _fileName;
 }
@@ -44,3 +47,21 @@ int64_t ConvertItem::getEndPosMs() const {
 void ConvertItem::setEndPosMs(int64_t value) {
   _endPosMs = value;
 }
+
+int ConvertItem::getPriority() const {
+  return _priority;
+}
+
+void ConvertItem::setPriority(int value) {
+  _priority = value;
+}
+
+bool ConvertItem::isProbing() const {
+  return _probing;
+}
+
+void ConvertItem::setProbed(int64_t durationMs) {
+  _durationMs = durationMs;
+  _endPosMs = std::min(static_cast<int64_t>(DefaultEndPos), durationMs);
+  _probing = false;
+}
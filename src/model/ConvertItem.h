@@ -5,6 +5,8 @@
 class ConvertItem {
  public:
   ConvertItem(QString filName, int64_t durationMs);
+  // Placeholder shown while the file is probed, see setProbed.
+  explicit ConvertItem(QString fileName);
   QString getFileName() const;
   int getProgress() const;
   void setProgress(int value);
@@ -14,13 +16,21 @@ class ConvertItem {
   void setBeginPosMs(int64_t value);
   int64_t getEndPosMs() const;
   void setEndPosMs(int64_t value);
+  // Pinned by the user to convert before unpinned items, 0 is unpinned.
+  int getPriority() const;
+  void setPriority(int value);
+  bool isProbing() const;
+  // Ends probing with the duration found and the default clip window.
+  void setProbed(int64_t durationMs);
 
  private:
   int64_t _beginPosMs = 0;
   int64_t _endPosMs = 0;
   int64_t _durationMs = 0;
   int _progress = 0;
-  const QString _fileName;
+  int _priority = 0;
+  bool _probing = false;
+  QString _fileName;
 };
 
 #endif  // CONVERTITEM_H
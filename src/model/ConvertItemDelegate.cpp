@@ -1,16 +1,26 @@
 #include "ConvertItemDelegate.h"
 
+#include <QAbstractItemView>
 #include <QApplication>
 #include <QPainter>
 
 #include "ConvertItemListModel.h"
+#include "ThumbnailCache.h"
 
 namespace {
-constexpr auto minHeight = 30;
-}
+constexpr auto minHeight = 40;
+constexpr QSize ThumbnailSize(64, 36);
+constexpr auto ThumbnailMargin = 2;
+}  // namespace
 
 ConvertItemDelegate::ConvertItemDelegate(QObject* parent)
-    : QStyledItemDelegate(parent) {}
+    : QStyledItemDelegate(parent),
+      thumbnails(new ThumbnailCache(ThumbnailSize, this)) {
+  if (auto* view = qobject_cast<QAbstractItemView*>(parent)) {
+    connect(thumbnails, &ThumbnailCache::thumbnailReady, view->viewport(),
+            qOverload<>(&QWidget::update));
+  }
+}
 
 void ConvertItemDelegate::paint(QPainter* painter,
                                 const QStyleOptionViewItem& option,
@@ -26,7 +36,9 @@ void ConvertItemDelegate::paint(QPainter* painter,
   progressBarOption.rect = option.rect;
   progressBarOption.fontMetrics = QFontMetrics(QApplication::font());
   progressBarOption.minimum = 0;
-  progressBarOption.maximum = 100;
+  // A zero range draws a busy bar while the file is still probed.
+  progressBarOption.maximum =
+      index.data(ConvertItemListModel::Roles::Probing).toBool() ? 0 : 100;
   progressBarOption.textVisible = false;
   progressBarOption.progress =
       index.data(ConvertItemListModel::Roles::Progress).toInt();
@@ -34,6 +46,22 @@ void ConvertItemDelegate::paint(QPainter* painter,
   QApplication::style()->drawControl(QStyle::CE_ProgressBar, &progressBarOption,
                                      painter);
 
+  // Only painted rows ask for a thumbnail, a null one is still decoding.
+  if (!index.data(ConvertItemListModel::Roles::Probing).toBool()) {
+    const auto thumbnail = thumbnails->thumbnail(
+        index.data(Qt::DisplayRole).toString(),
+        index.data(ConvertItemListModel::Roles::BeginPos).toLongLong());
+    if (!thumbnail.isNull()) {
+      const auto& rect = option.rect;
+      painter->drawPixmap(
+          rect.left() + ThumbnailMargin +
+              (ThumbnailSize.width() - thumbnail.width()) / 2,
+          rect.top() + (rect.height() - thumbnail.height()) / 2, thumbnail);
+    }
+    drawOption.rect.setLeft(option.rect.left() + ThumbnailSize.width() +
+                            ThumbnailMargin * 2);
+  }
+
   QStyledItemDelegate::paint(painter, drawOption, index);
 }
 
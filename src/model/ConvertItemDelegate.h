@@ -3,6 +3,8 @@
 
 #include <QStyledItemDelegate>
 
+class ThumbnailCache;
+
 class ConvertItemDelegate : public QStyledItemDelegate {
   Q_OBJECT
  public:
@@ -12,6 +14,11 @@ class ConvertItemDelegate : public QStyledItemDelegate {
              const QModelIndex& index) const override;
   QSize sizeHint(const QStyleOptionViewItem& option,
                  const QModelIndex& index) const override;
+
+ private:
+  // Keyframe at the clip begin, shown left of the file name. Repaints the
+  // view given as parent when a thumbnail arrives.
+  ThumbnailCache* thumbnails = nullptr;
 };
 
 #endif  // FILEDELEGATE_H
@@ -1,14 +1,30 @@
 #include "ConvertItemListModel.h"
 
 #include <QDebug>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QFont>
 #include <QMimeData>
 #include <QUrl>
 #include <QUuid>
+#include <algorithm>
+#include <functional>
 
-#include "ConvertItem.h"
-#include "utility/FFmpegUtility.h"
+#include "utility/MediaProbe.h"
 
-ConvertItemListModel::ConvertItemListModel() {}
+namespace {
+// Probes mostly wait on the disk or a network share, not on the CPU.
+constexpr auto ProbeThreads = 4;
+// Keyframe scans run after the probes of every added row.
+constexpr auto IndexPriority = -1;
+constexpr auto FlushIntervalMs = 100;
+}  // namespace
+
+ConvertItemListModel::ConvertItemListModel() : probePool(ProbeThreads) {
+  flushTimer.setInterval(FlushIntervalMs);
+  connect(&flushTimer, &QTimer::timeout, this,
+          &ConvertItemListModel::flushProbed);
+}
 
 int ConvertItemListModel::rowCount(const QModelIndex& parent) const {
   return items.size();
@@ -22,7 +38,7 @@ QVariant ConvertItemListModel::data(const QModelIndex& index, int role) const {
   if (role == Qt::DisplayRole) {
     return items[index.row()].getFileName();
   } else if (role == Roles::Uuid) {
-    return items.getUuid(index.row());
+    return items.uuidAt(index.row());
   } else if (role == Roles::Progress) {
     return items[index.row()].getProgress();
   } else if (role == Roles::Duration) {
@@ -31,6 +47,14 @@ QVariant ConvertItemListModel::data(const QModelIndex& index, int role) const {
     return items[index.row()].getBeginPosMs();
   } else if (role == Roles::EndPos) {
     return items[index.row()].getEndPosMs();
+  } else if (role == Roles::Probing) {
+    return items[index.row()].isProbing();
+  } else if (role == Roles::Priority) {
+    return items[index.row()].getPriority();
+  } else if (role == Qt::FontRole && items[index.row()].getPriority() > 0) {
+    QFont font;
+    font.setBold(true);
+    return font;
   }
 
   return QVariant();
@@ -49,28 +73,65 @@ bool ConvertItemListModel::setData(const QModelIndex& index,
   } else if (role == Roles::EndPos) {
     items[index.row()].setEndPosMs(value.toInt());
     return true;
+  } else if (role == Roles::Priority) {
+    items[index.row()].setPriority(value.toInt());
+    emit dataChanged(index, index, {role, Qt::FontRole});
+    return true;
   }
 
   return QAbstractListModel::setData(index, value, role);
 }
 
-bool ConvertItemListModel::removeRows(int row, int count, const QModelIndex&) {
-  const auto toRemove =
-      std::min(static_cast<size_t>(count - row), items.size());
-  for (int i = row; i < toRemove; ++i) {
-    items.erace(row);
-  }
+bool ConvertItemListModel::removeRows(int row,
+                                      int count,
+                                      const QModelIndex& parent) {
+  if (row < 0 || count <= 0 || static_cast<size_t>(row) >= items.size())
+    return false;
 
-  emit dataChanged(index(row), index(toRemove));
+  const auto last =
+      std::min(static_cast<size_t>(row) + count, items.size()) - 1;
+  beginRemoveRows(parent, row, static_cast<int>(last));
+  items.eraseAt(row, last - row + 1);
+  endRemoveRows();
   return true;
 }
 
-void ConvertItemListModel::updateProgress(QUuid uuid, int value) {
-  items[uuid].setProgress(value);
+void ConvertItemListModel::updateProgress(
+    const std::vector<ProgressUpdate>& updates) {
+  auto firstChanged = static_cast<int>(items.size());
+  auto lastChanged = -1;
+  for (const auto& update : updates) {
+    const auto row = items.indexOf(update.uuid);
+    if (row < 0)
+      continue;
+
+    items[row].setProgress(update.progress);
+    firstChanged = std::min(firstChanged, row);
+    lastChanged = std::max(lastChanged, row);
+  }
+
+  if (lastChanged >= 0)
+    emit dataChanged(index(firstChanged), index(lastChanged),
+                     {Roles::Progress});
 }
 
 QModelIndex ConvertItemListModel::getIndexForUuid(const QUuid uuid) {
-  return index(items.getKey(uuid));
+  const auto row = items.indexOf(uuid);
+  return row < 0 ? QModelIndex() : index(row);
+}
+
+void ConvertItemListModel::removeUuids(const QList<QUuid>& uuids) {
+  std::vector<int> rows;
+  for (const auto& uuid : uuids) {
+    const auto row = items.indexOf(uuid);
+    if (row >= 0)
+      rows.push_back(row);
+  }
+
+  // From the bottom up, so the rows left to remove keep their position.
+  std::sort(rows.begin(), rows.end(), std::greater<>());
+  for (const auto row : rows)
+    removeRows(row, 1);
 }
 
 Qt::DropActions ConvertItemListModel::supportedDropActions() const {
@@ -85,29 +146,43 @@ bool ConvertItemListModel::dropMimeData(const QMimeData* data,
   Q_UNUSED(row);
   Q_UNUSED(column);
   Q_UNUSED(action);
+  Q_UNUSED(parent);
 
-  const auto allUrls = data->urls();
-  const auto localFilesCount =
-      std::count_if(allUrls.begin(), allUrls.end(),
-                    [](const QUrl& u) { return u.isLocalFile(); });
-
-  if (localFilesCount > 0) {
-    beginInsertRows(parent, items.size(), items.size() + localFilesCount);
-
-    for (const auto& url : allUrls) {
-      if (url.isLocalFile()) {
-        const auto localFile = url.toLocalFile();
-        const auto duration = getVideoDurationMs(localFile);
-        if (duration > 0) {
-          items.push_back(ConvertItem(localFile, duration));
-        }
-      }
+  QStringList fileNames;
+  bool accepted = false;
+  for (const auto& url : data->urls()) {
+    if (!url.isLocalFile())
+      continue;
+    accepted = true;
+
+    const auto localFile = url.toLocalFile();
+    if (!QFileInfo(localFile).isDir()) {
+      fileNames.push_back(localFile);
+      continue;
     }
 
-    endInsertRows();
+    // Listing a large folder can be as slow as probing, so it runs on the
+    // pool too and its files are added by the next flush.
+    ++outstanding;
+    probePool.push([this, localFile] {
+      QStringList files;
+      QDirIterator it(localFile, QDir::Files, QDirIterator::Subdirectories);
+      while (it.hasNext())
+        files.push_back(it.next());
+      files.sort();
+      {
+        std::lock_guard lock(probedMutex);
+        discovered.append(files);
+      }
+      --outstanding;
+    });
   }
 
-  return localFilesCount > 0;
+  addProbing(fileNames);
+  if (accepted && !flushTimer.isActive())
+    flushTimer.start();
+
+  return accepted;
 }
 
 bool ConvertItemListModel::canDropMimeData(const QMimeData* data,
@@ -121,7 +196,110 @@ bool ConvertItemListModel::canDropMimeData(const QMimeData* data,
 Qt::ItemFlags ConvertItemListModel::flags(const QModelIndex& index) const {
   if (!index.isValid()) {
     return Qt::ItemIsDropEnabled;
+  } else if (items[index.row()].isProbing()) {
+    return Qt::ItemIsEnabled | Qt::ItemIsDropEnabled;
   }
 
   return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDropEnabled;
 }
+
+void ConvertItemListModel::addResumed(QUuid uuid,
+                                      const QString& fileName,
+                                      int64_t beginPosMs,
+                                      int64_t endPosMs,
+                                      int priority) {
+  // Probed before the crash, the duration comes from the probe cache when
+  // it still has the file. Never probed here, this runs on the GUI thread.
+  const auto info = MediaProbe::shared().cached(fileName);
+  ConvertItem item(fileName,
+                   std::max(info ? info->durationMs : 0, endPosMs));
+  item.setBeginPosMs(beginPosMs);
+  item.setEndPosMs(endPosMs);
+  item.setPriority(priority);
+
+  const auto row = static_cast<int>(items.size());
+  beginInsertRows(QModelIndex(), row, row);
+  items.insert(std::move(item), uuid);
+  endInsertRows();
+}
+
+void ConvertItemListModel::addProbing(const QStringList& fileNames) {
+  if (fileNames.isEmpty())
+    return;
+
+  const auto first = static_cast<int>(items.size());
+  beginInsertRows(QModelIndex(), first, first + fileNames.size() - 1);
+  for (const auto& fileName : fileNames) {
+    const auto handle = items.insert(ConvertItem(fileName));
+
+    ++outstanding;
+    probePool.push([this, handle, fileName] {
+      const auto info = MediaProbe::shared().probe(fileName);
+      {
+        std::lock_guard lock(probedMutex);
+        probed.push_back({handle, fileName, info ? info->durationMs : -1});
+      }
+      --outstanding;
+
+      // Trim previews only look the keyframe index up. A container that
+      // does not store one has its packets scanned now, in the background.
+      if (info && info->keyframesMs.empty()) {
+        probePool.push(
+            [fileName] {
+              MediaProbe::shared().probe(fileName, MediaProbe::Mode::Full);
+            },
+            IndexPriority);
+      }
+    });
+  }
+  endInsertRows();
+}
+
+void ConvertItemListModel::flushProbed() {
+  // Read before taking the results, every job that finished by now has
+  // already handed its result over.
+  const auto idle = outstanding == 0;
+
+  QStringList files;
+  std::vector<ProbeResult> results;
+  {
+    std::lock_guard lock(probedMutex);
+    files.swap(discovered);
+    results.swap(probed);
+  }
+
+  addProbing(files);
+
+  auto firstChanged = static_cast<int>(items.size());
+  auto lastChanged = -1;
+  std::vector<int> failedRows;
+  QStringList failed;
+  for (const auto& result : results) {
+    // The row may have been removed while it was probed.
+    const auto row = items.indexOf(result.handle);
+    if (row < 0)
+      continue;
+
+    if (result.durationMs > 0) {
+      items[row].setProbed(result.durationMs);
+      firstChanged = std::min(firstChanged, row);
+      lastChanged = std::max(lastChanged, row);
+    } else {
+      failedRows.push_back(row);
+      failed.push_back(result.fileName);
+    }
+  }
+
+  if (lastChanged >= 0)
+    emit dataChanged(index(firstChanged), index(lastChanged));
+
+  std::sort(failedRows.begin(), failedRows.end(), std::greater<>());
+  for (const auto row : failedRows) {
+    removeRows(row, 1);
+  }
+  if (!failed.isEmpty())
+    emit probeFailed(failed);
+
+  if (idle && outstanding == 0)
+    flushTimer.stop();
+}
@@ -3,11 +3,18 @@
 
 #include <QAbstractListModel>
 #include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QTimer>
 #include <QUuid>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
-#include "utility/MultiIndex.h"
-
-class ConvertItem;
+#include "ConvertItem.h"
+#include "utility/ProgressAggregator.h"
+#include "utility/SlotMap.h"
+#include "utility/ThreadPool.h"
 
 class ConvertItemListModel : public QAbstractListModel {
   Q_OBJECT
@@ -22,8 +29,19 @@ class ConvertItemListModel : public QAbstractListModel {
   bool removeRows(int row,
                   int count,
                   const QModelIndex& parent = QModelIndex()) override;
-  void updateProgress(QUuid uuid, int value);
+  // Applies a batch and emits a single dataChanged covering its rows.
+  void updateProgress(const std::vector<ProgressUpdate>& updates);
   QModelIndex getIndexForUuid(const QUuid uuid);
+  // Removes the rows of these items wherever they are now, uuids no longer
+  // in the list are skipped.
+  void removeUuids(const QList<QUuid>& uuids);
+  // Row of a job resumed from the convertor's journal, under the job's
+  // uuid so its progress reaches the row.
+  void addResumed(QUuid uuid,
+                  const QString& fileName,
+                  int64_t beginPosMs,
+                  int64_t endPosMs,
+                  int priority);
   Qt::DropActions supportedDropActions() const override;
   bool dropMimeData(const QMimeData* data,
                     Qt::DropAction action,
@@ -37,10 +55,45 @@ class ConvertItemListModel : public QAbstractListModel {
                        const QModelIndex& parent) const override;
   Qt::ItemFlags flags(const QModelIndex& index) const override;
 
-  enum Roles { Uuid = Qt::UserRole + 1, Progress, Duration, BeginPos, EndPos };
+  enum Roles {
+    Uuid = Qt::UserRole + 1,
+    Progress,
+    Duration,
+    BeginPos,
+    EndPos,
+    Probing,
+    Priority
+  };
+
+ signals:
+  // Dropped files that left the list again, because they could not be
+  // probed as video. Emitted once per batch.
+  void probeFailed(QStringList fileNames);
 
  private:
-  MultiIndex<ConvertItem> items;
+  using Items = SlotMap<ConvertItem>;
+
+  struct ProbeResult {
+    // Stays valid, or goes stale, while rows are removed during the probe.
+    Items::Handle handle;
+    QString fileName;
+    int64_t durationMs = -1;
+  };
+
+  // Appends probing rows and queues their probes, on the GUI thread only.
+  void addProbing(const QStringList& fileNames);
+  // Applies what the probe pool found since the last call in one batch.
+  void flushProbed();
+
+  Items items;
+  QTimer flushTimer;
+  std::mutex probedMutex;
+  QStringList discovered;
+  std::vector<ProbeResult> probed;
+  std::atomic_int outstanding{0};
+  // Last member, so running probes finish before the state they report to
+  // is destroyed.
+  ThreadPool probePool;
 };
 
 #endif  // CONVERTITEMLISTMODEL_H
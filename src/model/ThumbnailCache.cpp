@@ -0,0 +1,78 @@
+#include "ThumbnailCache.h"
+
+#include <QMetaObject>
+#include <algorithm>
+
+#include "utility/FrameGrabber.h"
+
+namespace {
+// Decodes mostly wait on the disk, two keep up with scrolling.
+constexpr auto DecodeThreads = 2;
+constexpr auto KiB = 1024;
+
+}  // namespace
+
+ThumbnailCache::ThumbnailCache(QSize size, QObject* parent)
+    : QObject(parent), size(size), pool(DecodeThreads) {
+  setMaxBytes(DefaultMaxBytes);
+}
+
+ThumbnailCache::~ThumbnailCache() {
+  pool.stop();
+}
+
+QPixmap ThumbnailCache::thumbnail(const QString& fileName,
+                                  int64_t positionMs) {
+  const auto key = fileName + '|' + QString::number(positionMs);
+  if (const auto* pixmap = cache.object(key))
+    return *pixmap;
+  if (requested.contains(key) || failed.contains(key))
+    return {};
+
+  requested.insert(key);
+  {
+    std::lock_guard lock(mutex);
+    queue.push_back({key, fileName, positionMs});
+    if (queue.size() > MaxPending) {
+      requested.remove(queue.front().key);
+      queue.pop_front();
+    }
+  }
+  pool.push([this] { decodeNext(); });
+
+  return {};
+}
+
+void ThumbnailCache::setMaxBytes(int64_t value) {
+  cache.setMaxCost(static_cast<int>(value / KiB));
+}
+
+void ThumbnailCache::decodeNext() {
+  Request request;
+  {
+    std::lock_guard lock(mutex);
+    // Dropped past MaxPending, its job has nothing left to do.
+    if (queue.empty())
+      return;
+    request = std::move(queue.back());
+    queue.pop_back();
+  }
+
+  FrameGrabber grabber(request.fileName);
+  const auto image = grabber.keyframe(request.positionMs, size);
+  QMetaObject::invokeMethod(
+      this, [this, key = request.key, image] { insert(key, image); },
+      Qt::QueuedConnection);
+}
+
+void ThumbnailCache::insert(const QString& key, const QImage& image) {
+  requested.remove(key);
+  if (image.isNull()) {
+    failed.insert(key);
+    return;
+  }
+
+  const auto cost = std::max(static_cast<int>(image.sizeInBytes() / KiB), 1);
+  cache.insert(key, new QPixmap(QPixmap::fromImage(image)), cost);
+  emit thumbnailReady();
+}
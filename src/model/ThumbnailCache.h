@@ -0,0 +1,65 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "utility/ThreadPool.h"
+
+// Keyframe thumbnails of clips for the list, decoded on a small pool and
+// kept in an LRU bounded by pixmap bytes. Lookups never touch FFmpeg.
+// Requests run newest first and only the last MaxPending are kept, so a
+// fast scroll decodes the rows it stops at; rows scrolled past are asked
+// for again if they are painted again.
+class ThumbnailCache : public QObject {
+  Q_OBJECT
+ public:
+  explicit ThumbnailCache(QSize size, QObject* parent = nullptr);
+  ~ThumbnailCache() override;
+
+  // The thumbnail when it is cached, otherwise a null pixmap and the
+  // decode is queued. thumbnailReady follows once it is cached.
+  QPixmap thumbnail(const QString& fileName, int64_t positionMs);
+  void setMaxBytes(int64_t value);
+
+  static constexpr int64_t DefaultMaxBytes = 32 * 1024 * 1024;
+  static constexpr size_t MaxPending = 64;
+
+ signals:
+  void thumbnailReady();
+
+ private:
+  struct Request {
+    QString key;
+    QString fileName;
+    int64_t positionMs = 0;
+  };
+
+  // Pool side, decodes the newest queued request.
+  void decodeNext();
+  // GUI side, caches a decoded thumbnail.
+  void insert(const QString& key, const QImage& image);
+
+  const QSize size;
+  // Costs are in KiB, QCache counts them in int.
+  QCache<QString, QPixmap> cache;
+  // Keys queued or decoding, and keys that failed to decode.
+  QSet<QString> requested;
+  QSet<QString> failed;
+
+  std::mutex mutex;
+  std::deque<Request> queue;
+  // Last member, so running decodes finish before the state they report
+  // to is destroyed.
+  ThreadPool pool;
+};
+
+#endif  // THUMBNAILCACHE_H
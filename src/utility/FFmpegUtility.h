@@ -3,6 +3,7 @@
 
 #include <QString>
 #include <cstdint>
+// Fast probe through the shared MediaProbe cache, -1 when not a video.
 int64_t getVideoDurationMs(QString fileName);
 
 #endif  // FFMPEGUTILITY_H
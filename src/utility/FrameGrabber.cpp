@@ -0,0 +1,270 @@
+#include "FrameGrabber.h"
+
+#include <QByteArray>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace {
+constexpr AVRational MsTimeBase = {1, 1000};
+constexpr int64_t FallbackFrameDurationMs = 40;
+// Frames decoded this close before a target are cached, earlier ones on
+// the way from the keyframe are decoded only when referenced.
+constexpr int64_t CacheWindowMs = 1000;
+// About three seconds at 30 fps, a few MiB at preview sizes.
+constexpr size_t MaxCachedFrames = 96;
+
+}  // namespace
+
+FrameGrabber::FrameGrabber(const QString& fileName)
+    : frame(av_frame_alloc()), packet(av_packet_alloc()) {
+  const auto path = fileName.toUtf8();
+  if (!frame || !packet ||
+      avformat_open_input(&formatContext, path.constData(), nullptr,
+                          nullptr) != 0) {
+    return;
+  }
+  if (avformat_find_stream_info(formatContext, nullptr) < 0)
+    return;
+
+  const AVCodec* codec = nullptr;
+  const auto index = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1,
+                                         -1, &codec, 0);
+  if (index < 0)
+    return;
+  for (unsigned int i = 0; i < formatContext->nb_streams; ++i) {
+    formatContext->streams[i]->discard =
+        static_cast<int>(i) == index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
+
+  const auto* codecpar = formatContext->streams[index]->codecpar;
+  auto context = AVCodecContextPtr(avcodec_alloc_context3(codec));
+  if (!context || avcodec_parameters_to_context(context.get(), codecpar) < 0 ||
+      avcodec_open2(context.get(), codec, nullptr) < 0) {
+    return;
+  }
+
+  codecContext = std::move(context);
+  stream = formatContext->streams[index];
+  startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+  const auto rate = av_guess_frame_rate(formatContext, stream, nullptr);
+  frameDurationMs =
+      rate.num > 0 && rate.den > 0
+          ? std::max<int64_t>(av_rescale(1000, rate.den, rate.num), 1)
+          : FallbackFrameDurationMs;
+}
+
+FrameGrabber::~FrameGrabber() {
+  sws_freeContext(scaleContext);
+  codecContext.reset();
+  avformat_close_input(&formatContext);
+}
+
+bool FrameGrabber::isOpen() const noexcept {
+  return stream != nullptr;
+}
+
+void FrameGrabber::setSeekIndex(std::vector<SeekPoint> index) {
+  seekIndex = std::move(index);
+}
+
+QImage FrameGrabber::keyframe(int64_t positionMs, QSize size) {
+  if (!isOpen())
+    return {};
+
+  const auto target =
+      startTime + av_rescale_q(positionMs, MsTimeBase, stream->time_base);
+  av_seek_frame(formatContext, stream->index, target, AVSEEK_FLAG_BACKWARD);
+  avcodec_flush_buffers(codecContext.get());
+  decodedMs = -1;
+  lastCachedMs = -1;
+
+  // Everything but the keyframe the seek landed on is skipped undecoded.
+  codecContext->skip_frame = AVDISCARD_NONKEY;
+  auto received = false;
+  while (!received && av_read_frame(formatContext, packet.get()) >= 0) {
+    if (packet->stream_index == stream->index &&
+        avcodec_send_packet(codecContext.get(), packet.get()) >= 0) {
+      received = avcodec_receive_frame(codecContext.get(), frame.get()) >= 0;
+    }
+    av_packet_unref(packet.get());
+  }
+  if (!received) {
+    avcodec_send_packet(codecContext.get(), nullptr);
+    received = avcodec_receive_frame(codecContext.get(), frame.get()) >= 0;
+  }
+  codecContext->skip_frame = AVDISCARD_DEFAULT;
+
+  if (!received)
+    return {};
+
+  auto image = toImage(frame.get(), size);
+  av_frame_unref(frame.get());
+  return image;
+}
+
+QImage FrameGrabber::toImage(const AVFrame* source, QSize size) {
+  const auto scaled =
+      QSize(source->width, source->height).scaled(size, Qt::KeepAspectRatio);
+  if (scaled.isEmpty())
+    return {};
+
+  scaleContext = sws_getCachedContext(
+      scaleContext, source->width, source->height,
+      static_cast<AVPixelFormat>(source->format), scaled.width(),
+      scaled.height(), AV_PIX_FMT_RGB32, SWS_BILINEAR, nullptr, nullptr,
+      nullptr);
+  if (!scaleContext)
+    return {};
+
+  // AV_PIX_FMT_RGB32 is native endian 0xAARRGGBB, like QImage's.
+  QImage image(scaled, QImage::Format_RGB32);
+  uint8_t* data[] = {image.bits()};
+  const int linesize[] = {static_cast<int>(image.bytesPerLine())};
+  sws_scale(scaleContext, source->data, source->linesize, 0, source->height,
+            data, linesize);
+  return image;
+}
+
+QImage FrameGrabber::frameAt(int64_t positionMs,
+                             QSize size,
+                             const Progress& progress) {
+  if (!isOpen())
+    return {};
+
+  if (size != framesSize) {
+    frames.clear();
+    lastCachedMs = -1;
+    framesSize = size;
+  }
+  if (auto image = cachedFrame(positionMs); !image.isNull())
+    return image;
+
+  // Decoding on from the previous target beats a seek as long as the
+  // keyframe before this one is not past it.
+  const auto point = seekPointBefore(positionMs);
+  const auto onTheWay =
+      decodedMs >= 0 && decodedMs <= positionMs &&
+      (seekIndex.empty() ? positionMs - decodedMs <= CacheWindowMs
+                         : decodedMs >= point.timeMs);
+  if (!onTheWay)
+    seekTo(point);
+
+  const auto keepFromMs = positionMs - CacheWindowMs;
+  QImage last;
+  while (decodeNext(keepFromMs)) {
+    const auto beginMs = timeMs(frame->best_effort_timestamp);
+    // The first frame after a seek is the keyframe, worth showing while
+    // the rest of the way is decoded.
+    const auto keep = beginMs >= keepFromMs || decodedMs < 0;
+    decodedMs = beginMs;
+
+    QImage image;
+    if (keep) {
+      image = toImage(frame.get(), size);
+      cache(beginMs, image, positionMs);
+      last = image;
+    } else {
+      lastCachedMs = -1;
+    }
+    av_frame_unref(frame.get());
+
+    if (beginMs + frameDurationMs > positionMs)
+      return last;
+    if (progress && !progress(image))
+      return {};
+  }
+
+  // Drained at the end of the stream, the next target seeks again.
+  decodedMs = -1;
+  return last;
+}
+
+int64_t FrameGrabber::timeMs(int64_t timestamp) const {
+  return av_rescale_q(timestamp - startTime, stream->time_base, MsTimeBase);
+}
+
+FrameGrabber::SeekPoint FrameGrabber::seekPointBefore(
+    int64_t positionMs) const {
+  if (seekIndex.empty())
+    return {positionMs, -1};
+
+  const auto next = std::upper_bound(
+      seekIndex.begin(), seekIndex.end(), positionMs,
+      [](int64_t value, const SeekPoint& point) {
+        return value < point.timeMs;
+      });
+  return next == seekIndex.begin() ? seekIndex.front() : *std::prev(next);
+}
+
+void FrameGrabber::seekTo(const SeekPoint& point) {
+  // Containers without an index of their own, MPEG-TS among them, find a
+  // timestamp by bisecting the file, the probed offset goes there at once.
+  auto seeked = false;
+  if (point.offset >= 0 && avformat_index_get_entries_count(stream) == 0 &&
+      !(formatContext->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+    seeked = av_seek_frame(formatContext, stream->index, point.offset,
+                           AVSEEK_FLAG_BYTE) >= 0;
+  }
+  if (!seeked) {
+    // Index times are rounded to ms, one more keeps a backward seek from
+    // falling back a whole GOP.
+    const auto target =
+        startTime +
+        av_rescale_q(point.timeMs + 1, MsTimeBase, stream->time_base);
+    av_seek_frame(formatContext, stream->index, target, AVSEEK_FLAG_BACKWARD);
+  }
+  avcodec_flush_buffers(codecContext.get());
+  decodedMs = -1;
+  lastCachedMs = -1;
+}
+
+bool FrameGrabber::decodeNext(int64_t skipBeforeMs) {
+  for (;;) {
+    const auto received =
+        avcodec_receive_frame(codecContext.get(), frame.get());
+    if (received >= 0)
+      return true;
+    if (received != AVERROR(EAGAIN))
+      return false;
+
+    if (av_read_frame(formatContext, packet.get()) < 0) {
+      avcodec_send_packet(codecContext.get(), nullptr);
+      continue;
+    }
+    if (packet->stream_index == stream->index) {
+      const auto skip =
+          packet->pts != AV_NOPTS_VALUE && timeMs(packet->pts) < skipBeforeMs;
+      codecContext->skip_frame = skip ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+      avcodec_send_packet(codecContext.get(), packet.get());
+    }
+    av_packet_unref(packet.get());
+  }
+}
+
+QImage FrameGrabber::cachedFrame(int64_t positionMs) const {
+  auto next = frames.upper_bound(positionMs);
+  if (next == frames.begin())
+    return {};
+  const auto& cached = std::prev(next)->second;
+  return positionMs < cached.endMs ? cached.image : QImage();
+}
+
+void FrameGrabber::cache(int64_t beginMs, QImage image, int64_t positionMs) {
+  if (const auto previous = frames.find(lastCachedMs);
+      previous != frames.end() && lastCachedMs < beginMs) {
+    previous->second.endMs = beginMs;
+  }
+  frames[beginMs] = {beginMs + frameDurationMs, std::move(image)};
+  lastCachedMs = beginMs;
+
+  // Frames farthest from the cursor go first.
+  while (frames.size() > MaxCachedFrames) {
+    const auto first = frames.begin();
+    const auto last = std::prev(frames.end());
+    if (positionMs - first->first >= last->first - positionMs)
+      frames.erase(first);
+    else
+      frames.erase(last);
+  }
+}
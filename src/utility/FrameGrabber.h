@@ -0,0 +1,91 @@
+#ifndef FRAMEGRABBER_H
+#define FRAMEGRABBER_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "converter/StreamingContext.h"
+
+// Decodes single frames of a video file into images for previews. Keeps
+// the file and decoder open between grabs, one instance per thread.
+class FrameGrabber {
+ public:
+  explicit FrameGrabber(const QString& fileName);
+  ~FrameGrabber();
+
+  FrameGrabber(const FrameGrabber&) = delete;
+  FrameGrabber& operator=(const FrameGrabber&) = delete;
+
+  // A keyframe of the stream, offset is its byte position in the file or
+  // -1 when unknown.
+  struct SeekPoint {
+    int64_t timeMs = 0;
+    int64_t offset = -1;
+  };
+
+  // Called after each frame decoded on the way to the target of frameAt,
+  // with its image or a null one for frames decoded as references only.
+  // Returning false abandons the decode.
+  using Progress = std::function<bool(const QImage& image)>;
+
+  // False when the file can not be opened or has no decodable video.
+  bool isOpen() const noexcept;
+
+  // Keyframes from the probe, ascending. Without them frameAt relies on
+  // the demuxer to find the keyframe before a position.
+  void setSeekIndex(std::vector<SeekPoint> index);
+
+  // The keyframe at or before positionMs, scaled to fit size. Decodes a
+  // single frame, null on failure.
+  QImage keyframe(int64_t positionMs, QSize size);
+
+  // The frame shown at positionMs, scaled to fit size, null on failure.
+  // Decodes on from the previous target when no keyframe lies in between,
+  // and frames decoded near a target are cached, so a slider moved back
+  // and forth mostly decodes nothing.
+  QImage frameAt(int64_t positionMs, QSize size,
+                 const Progress& progress = {});
+
+ private:
+  struct CachedFrame {
+    // Begin of the next decoded frame, or a guess from the frame rate
+    // until it is decoded.
+    int64_t endMs = 0;
+    QImage image;
+  };
+
+  QImage toImage(const AVFrame* frame, QSize size);
+  int64_t timeMs(int64_t timestamp) const;
+  SeekPoint seekPointBefore(int64_t positionMs) const;
+  void seekTo(const SeekPoint& point);
+  // Decodes the next frame into frame, packets before skipBeforeMs only
+  // when other frames reference them. False at the end of the stream.
+  bool decodeNext(int64_t skipBeforeMs);
+  QImage cachedFrame(int64_t positionMs) const;
+  void cache(int64_t beginMs, QImage image, int64_t positionMs);
+
+  AVFormatContext* formatContext = nullptr;
+  AVCodecContextPtr codecContext;
+  AVStream* stream = nullptr;
+  AVFramePtr frame;
+  AVPacketPtr packet;
+  SwsContext* scaleContext = nullptr;
+  int64_t startTime = 0;
+  int64_t frameDurationMs = 0;
+
+  std::vector<SeekPoint> seekIndex;
+  // Decoded frames by begin time, all scaled to framesSize.
+  std::map<int64_t, CachedFrame> frames;
+  QSize framesSize;
+  // Time of the frame decoded last, -1 when the decoder has to seek.
+  int64_t decodedMs = -1;
+  // Cached frame decoded last, its end is the begin of the next one.
+  int64_t lastCachedMs = -1;
+};
+
+#endif  // FRAMEGRABBER_H
@@ -0,0 +1,391 @@
+#include "MediaProbe.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <utility>
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+namespace {
+constexpr auto CacheFileName = "TgCreateEmoji/media-probe.json";
+constexpr auto CacheVersion = 2;
+// Older entries are dropped on save past this count.
+constexpr size_t MaxCacheEntries = 4096;
+// Enough for the headers of common containers, a fraction of the defaults.
+constexpr auto FastProbeSize = 512 * 1024;
+constexpr auto FastAnalyzeDurationUs = 500 * 1000;
+constexpr AVRational MsTimeBase{1, 1000};
+
+struct InputContextDeleter {
+  void operator()(AVFormatContext* context) {
+    if (context)
+      avformat_close_input(&context);
+  }
+};
+
+using InputContextPtr = std::unique_ptr<AVFormatContext, InputContextDeleter>;
+
+int64_t streamTimeMs(const AVStream* stream, int64_t timestamp) {
+  const auto start =
+      stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+  return av_rescale_q(timestamp - start, stream->time_base, MsTimeBase);
+}
+
+void readIndexKeyframes(const AVStream* stream, MediaInfo& info) {
+  const auto count = avformat_index_get_entries_count(stream);
+  for (int i = 0; i < count; ++i) {
+    const auto* entry = avformat_index_get_entry(stream, i);
+    if (entry && (entry->flags & AVINDEX_KEYFRAME)) {
+      info.keyframesMs.push_back(streamTimeMs(stream, entry->timestamp));
+      info.keyframeOffsets.push_back(entry->pos);
+    }
+  }
+}
+
+// Demuxes the video stream only, no packet is decoded.
+void scanKeyframes(AVFormatContext* context, int index, MediaInfo& info) {
+  for (unsigned i = 0; i < context->nb_streams; ++i) {
+    if (static_cast<int>(i) != index)
+      context->streams[i]->discard = AVDISCARD_ALL;
+  }
+
+  const auto* stream = context->streams[index];
+  auto* packet = av_packet_alloc();
+  while (av_read_frame(context, packet) >= 0) {
+    if (packet->stream_index == index && (packet->flags & AV_PKT_FLAG_KEY)) {
+      const auto timestamp =
+          packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+      if (timestamp != AV_NOPTS_VALUE) {
+        info.keyframesMs.push_back(streamTimeMs(stream, timestamp));
+        info.keyframeOffsets.push_back(packet->pos);
+      }
+    }
+    av_packet_unref(packet);
+  }
+  av_packet_free(&packet);
+}
+
+// Orders keyframes by time and drops duplicates, offsets follow along.
+void sortKeyframes(MediaInfo& info) {
+  std::vector<std::pair<int64_t, int64_t>> keyframes;
+  keyframes.reserve(info.keyframesMs.size());
+  for (size_t i = 0; i < info.keyframesMs.size(); ++i)
+    keyframes.emplace_back(info.keyframesMs[i], info.keyframeOffsets[i]);
+  std::sort(keyframes.begin(), keyframes.end());
+
+  info.keyframesMs.clear();
+  info.keyframeOffsets.clear();
+  for (const auto& [timeMs, offset] : keyframes) {
+    if (!info.keyframesMs.empty() && info.keyframesMs.back() == timeMs)
+      continue;
+    info.keyframesMs.push_back(timeMs);
+    info.keyframeOffsets.push_back(offset);
+  }
+}
+
+std::optional<MediaInfo> readMediaInfo(const QString& fileName,
+                                       MediaProbe::Mode mode) {
+  const auto fileNameStd = fileName.toStdString();
+  const auto fast = mode == MediaProbe::Mode::Fast;
+
+  AVDictionary* options = nullptr;
+  if (fast) {
+    av_dict_set_int(&options, "probesize", FastProbeSize, 0);
+    av_dict_set_int(&options, "analyzeduration", FastAnalyzeDurationUs, 0);
+  }
+
+  AVFormatContext* context = nullptr;
+  const auto opened =
+      avformat_open_input(&context, fileNameStd.c_str(), nullptr, &options);
+  av_dict_free(&options);
+  if (opened != 0) {
+    return std::nullopt;
+  }
+  auto input = InputContextPtr(context);
+
+  if (avformat_find_stream_info(input.get(), nullptr) < 0) {
+    return std::nullopt;
+  }
+
+  const auto index = av_find_best_stream(input.get(), AVMEDIA_TYPE_VIDEO, -1,
+                                         -1, nullptr, 0);
+  if (index < 0) {
+    return std::nullopt;
+  }
+  auto* stream = input->streams[index];
+
+  MediaInfo info;
+  if (input->duration != AV_NOPTS_VALUE) {
+    info.durationMs = av_rescale_q(input->duration, AV_TIME_BASE_Q, MsTimeBase);
+  } else if (stream->duration != AV_NOPTS_VALUE) {
+    info.durationMs = av_rescale_q(stream->duration, stream->time_base,
+                                   MsTimeBase);
+  }
+  info.codec = avcodec_get_name(stream->codecpar->codec_id);
+  info.width = stream->codecpar->width;
+  info.height = stream->codecpar->height;
+  auto rate = stream->avg_frame_rate;
+  if (rate.num <= 0 || rate.den <= 0)
+    rate = stream->r_frame_rate;
+  if (rate.num > 0 && rate.den > 0)
+    info.fps = av_q2d(rate);
+
+  readIndexKeyframes(stream, info);
+  if (info.keyframesMs.empty()) {
+    // Some demuxers, Matroska among them, defer reading their index until
+    // the first seek. Seeking to the start is cheap and loads it.
+    const auto start =
+        stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    if (av_seek_frame(input.get(), index, start, AVSEEK_FLAG_BACKWARD) >= 0) {
+      readIndexKeyframes(stream, info);
+    }
+  }
+  if (info.keyframesMs.empty() && !fast) {
+    scanKeyframes(input.get(), index, info);
+  }
+
+  sortKeyframes(info);
+
+  return info;
+}
+
+// QJsonValue::toInteger is Qt 6 only, doubles hold these values exactly.
+int64_t toInt64(const QJsonValue& value) {
+  return static_cast<int64_t>(value.toDouble());
+}
+
+QJsonObject toJson(const MediaInfo& info) {
+  QJsonArray keyframes;
+  for (const auto keyframe : info.keyframesMs)
+    keyframes.append(static_cast<qint64>(keyframe));
+  QJsonArray offsets;
+  for (const auto offset : info.keyframeOffsets)
+    offsets.append(static_cast<qint64>(offset));
+
+  return {{"durationMs", static_cast<qint64>(info.durationMs)},
+          {"codec", info.codec},
+          {"width", info.width},
+          {"height", info.height},
+          {"fps", info.fps},
+          {"keyframesMs", keyframes},
+          {"keyframeOffsets", offsets}};
+}
+
+MediaInfo fromJson(const QJsonObject& object) {
+  MediaInfo info;
+  info.durationMs = toInt64(object.value("durationMs"));
+  info.codec = object.value("codec").toString();
+  info.width = object.value("width").toInt();
+  info.height = object.value("height").toInt();
+  info.fps = object.value("fps").toDouble();
+  const auto keyframes = object.value("keyframesMs").toArray();
+  info.keyframesMs.reserve(keyframes.size());
+  for (const auto& keyframe : keyframes)
+    info.keyframesMs.push_back(toInt64(keyframe));
+  const auto offsets = object.value("keyframeOffsets").toArray();
+  for (const auto& offset : offsets)
+    info.keyframeOffsets.push_back(toInt64(offset));
+  info.keyframeOffsets.resize(info.keyframesMs.size(), -1);
+
+  return info;
+}
+
+}  // namespace
+
+MediaProbe::MediaProbe(QString cacheFile) : cacheFile(std::move(cacheFile)) {
+  if (!this->cacheFile.isEmpty())
+    writer = std::thread(&MediaProbe::run, this);
+}
+
+MediaProbe::~MediaProbe() {
+  if (writer.joinable()) {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+  }
+  save();
+}
+
+std::optional<MediaInfo> MediaProbe::probe(const QString& fileName,
+                                           Mode mode) {
+  const QFileInfo file(fileName);
+  if (!file.isFile()) {
+    qDebug() << "failed to open input file " << fileName;
+    return std::nullopt;
+  }
+
+  {
+    std::lock_guard lock(mutex);
+    if (auto info = lookup(file, mode))
+      return info;
+  }
+
+  // Probed without the lock, so a slow share does not stall other files.
+  const auto key = file.absoluteFilePath();
+  auto info = readMediaInfo(key, mode);
+  if (mode == Mode::Fast && (!info || info->durationMs <= 0)) {
+    // The capped probe missed what the header did not state directly.
+    mode = Mode::Full;
+    info = readMediaInfo(key, mode);
+  }
+  if (!info) {
+    qDebug() << "failed to open input file " << fileName;
+    return std::nullopt;
+  }
+
+  std::lock_guard lock(mutex);
+  entries.insert(key, {file.size(), file.lastModified().toMSecsSinceEpoch(),
+                       QDateTime::currentMSecsSinceEpoch(), mode, *info});
+  dirty = true;
+  saveRequested = true;
+  wake.notify_one();
+
+  return info;
+}
+
+std::optional<MediaInfo> MediaProbe::cached(const QString& fileName,
+                                            Mode mode) {
+  const QFileInfo file(fileName);
+  if (!file.isFile())
+    return std::nullopt;
+
+  std::lock_guard lock(mutex);
+  return lookup(file, mode);
+}
+
+void MediaProbe::save() {
+  // Serialized under the lock, written without it so probes go on.
+  std::lock_guard saving(saveMutex);
+  std::unique_lock lock(mutex);
+  if (!dirty || cacheFile.isEmpty())
+    return;
+
+  std::vector<QHash<QString, Entry>::const_iterator> recent;
+  recent.reserve(entries.size());
+  for (auto it = entries.cbegin(); it != entries.cend(); ++it)
+    recent.push_back(it);
+  std::sort(recent.begin(), recent.end(), [](const auto& lhs, const auto& rhs) {
+    return lhs->usedAtMs > rhs->usedAtMs;
+  });
+  if (recent.size() > MaxCacheEntries)
+    recent.resize(MaxCacheEntries);
+
+  QJsonObject files;
+  for (const auto& it : recent) {
+    auto object = toJson(it->info);
+    object.insert("size", static_cast<qint64>(it->size));
+    object.insert("modifiedMs", static_cast<qint64>(it->modifiedMs));
+    object.insert("usedAtMs", static_cast<qint64>(it->usedAtMs));
+    object.insert("full", it->mode == Mode::Full);
+    files.insert(it.key(), object);
+  }
+  const QJsonObject document{{"version", CacheVersion}, {"files", files}};
+  dirty = false;
+  lock.unlock();
+
+  // QSaveFile writes a temporary file and renames it over the cache, a
+  // crash midway leaves the previous one intact.
+  QDir().mkpath(QFileInfo(cacheFile).absolutePath());
+  QSaveFile file(cacheFile);
+  if (!file.open(QFile::WriteOnly)) {
+    qDebug() << "failed to write probe cache " << cacheFile;
+    lock.lock();
+    dirty = true;
+    return;
+  }
+  file.write(QJsonDocument(document).toJson(QJsonDocument::Compact));
+  if (!file.commit()) {
+    lock.lock();
+    dirty = true;
+  }
+}
+
+void MediaProbe::clear() {
+  std::lock_guard lock(mutex);
+  entries.clear();
+  loaded = true;
+  dirty = true;
+  saveRequested = true;
+  wake.notify_one();
+}
+
+QString MediaProbe::defaultCacheFile() {
+  return QDir(QStandardPaths::writableLocation(
+                  QStandardPaths::GenericCacheLocation))
+      .absoluteFilePath(CacheFileName);
+}
+
+MediaProbe& MediaProbe::shared() {
+  static MediaProbe probe;
+  return probe;
+}
+
+std::optional<MediaInfo> MediaProbe::lookup(const QFileInfo& file,
+                                            Mode mode) {
+  load();
+  const auto it = entries.find(file.absoluteFilePath());
+  if (it == entries.end() || it->size != file.size() ||
+      it->modifiedMs != file.lastModified().toMSecsSinceEpoch() ||
+      (it->mode == Mode::Fast && mode == Mode::Full)) {
+    return std::nullopt;
+  }
+
+  it->usedAtMs = QDateTime::currentMSecsSinceEpoch();
+  dirty = true;
+  return it->info;
+}
+
+void MediaProbe::run() {
+  std::unique_lock lock(mutex);
+  while (!stopping) {
+    wake.wait(lock, [this] { return stopping || saveRequested; });
+    // Batched, results of the next SaveDelayMs are written along.
+    wake.wait_for(lock, std::chrono::milliseconds(SaveDelayMs),
+                  [this] { return stopping; });
+    saveRequested = false;
+
+    lock.unlock();
+    save();
+    lock.lock();
+  }
+}
+
+void MediaProbe::load() {
+  if (loaded)
+    return;
+  loaded = true;
+
+  QFile file(cacheFile);
+  if (cacheFile.isEmpty() || !file.open(QFile::ReadOnly))
+    return;
+
+  const auto document = QJsonDocument::fromJson(file.readAll()).object();
+  if (document.value("version").toInt() != CacheVersion)
+    return;
+
+  const auto files = document.value("files").toObject();
+  for (auto it = files.begin(); it != files.end(); ++it) {
+    const auto object = it.value().toObject();
+    entries.insert(it.key(), {toInt64(object.value("size")),
+                              toInt64(object.value("modifiedMs")),
+                              toInt64(object.value("usedAtMs")),
+                              object.value("full").toBool() ? Mode::Full
+                                                            : Mode::Fast,
+                              fromJson(object)});
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef MEDIAPROBE_H
+#define MEDIAPROBE_H
+
+#include <QFileInfo>
+#include <QHash>
+#include <QString>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+struct MediaInfo {
+  int64_t durationMs = 0;
+  QString codec;
+  int width = 0;
+  int height = 0;
+  double fps = 0;
+  // Video keyframe times from the start of the stream, ascending. Empty
+  // for a fast probe of a container without an index.
+  std::vector<int64_t> keyframesMs;
+  // Byte offsets of those keyframes in the file, -1 where the container
+  // does not store one. Same length as keyframesMs.
+  std::vector<int64_t> keyframeOffsets;
+};
+
+// Reads media properties and remembers them in memory and in a JSON file,
+// keyed by path, size and modification time, so files seen by an earlier
+// session are not opened again. New results are written by a background
+// thread SaveDelayMs after a probe, a session that dies loses no more.
+// Safe to call from several threads.
+class MediaProbe {
+ public:
+  enum class Mode {
+    // Caps probesize and analyzeduration, keyframes come from the
+    // container index only.
+    Fast,
+    // Reads the whole stream info, scans packets when there is no index.
+    Full,
+  };
+
+  explicit MediaProbe(QString cacheFile = defaultCacheFile());
+  ~MediaProbe();
+
+  MediaProbe(const MediaProbe&) = delete;
+  MediaProbe& operator=(const MediaProbe&) = delete;
+
+  // Empty when the file can not be opened or has no video stream. A full
+  // result is reused for fast probes, but not the other way round.
+  std::optional<MediaInfo> probe(const QString& fileName,
+                                 Mode mode = Mode::Fast);
+  // The cached result only, empty when the file was not probed in that
+  // mode yet or changed since. Never opens the file.
+  std::optional<MediaInfo> cached(const QString& fileName,
+                                  Mode mode = Mode::Fast);
+
+  // Writes new results to the cache file now, also done on destruction.
+  void save();
+  void clear();
+
+  static constexpr int SaveDelayMs = 2000;
+
+  static QString defaultCacheFile();
+  // Process-wide instance backed by the default cache file.
+  static MediaProbe& shared();
+
+ private:
+  struct Entry {
+    int64_t size = 0;
+    int64_t modifiedMs = 0;
+    int64_t usedAtMs = 0;
+    Mode mode = Mode::Fast;
+    MediaInfo info;
+  };
+
+  // Caller holds the mutex. Marks a hit as used.
+  std::optional<MediaInfo> lookup(const QFileInfo& file, Mode mode);
+  void load();
+  // Writer thread, saves SaveDelayMs after the first unsaved result.
+  void run();
+
+  const QString cacheFile;
+  // Taken before mutex, one save writes the file at a time.
+  std::mutex saveMutex;
+  std::mutex mutex;
+  std::condition_variable wake;
+  QHash<QString, Entry> entries;
+  bool loaded = false;
+  bool dirty = false;
+  bool saveRequested = false;
+  bool stopping = false;
+  // Last member, started once the rest is constructed.
+  std::thread writer;
+};
+
+#endif  // MEDIAPROBE_H
@@ -0,0 +1,56 @@
+#include "ProgressAggregator.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+// Fast enough for a progress bar, slow enough to stay out of the profile.
+constexpr auto DefaultIntervalMs = 50;
+}  // namespace
+
+void ProgressSlot::set(int newValue) noexcept {
+  value.store(newValue, std::memory_order_relaxed);
+  changed.store(true, std::memory_order_release);
+}
+
+void ProgressSlot::finish(int newValue) noexcept {
+  // Published before finished, so a tick that sees the slot finished also
+  // sees its last value.
+  set(newValue);
+  finished.store(true, std::memory_order_release);
+}
+
+ProgressAggregator::ProgressAggregator(QObject* parent) : QObject(parent) {
+  timer.setInterval(DefaultIntervalMs);
+  connect(&timer, &QTimer::timeout, this, &ProgressAggregator::tick);
+}
+
+std::shared_ptr<ProgressSlot> ProgressAggregator::track(QUuid uuid) {
+  auto slot = std::make_shared<ProgressSlot>();
+  slots.insert(uuid, slot);
+  if (!timer.isActive())
+    timer.start();
+
+  return slot;
+}
+
+void ProgressAggregator::setInterval(int intervalMs) {
+  timer.setInterval(std::max(intervalMs, 1));
+}
+
+void ProgressAggregator::tick() {
+  std::vector<ProgressUpdate> updates;
+  for (auto it = slots.begin(); it != slots.end();) {
+    auto& slot = *it.value();
+    const auto finished = slot.finished.load(std::memory_order_acquire);
+    if (slot.changed.exchange(false, std::memory_order_acquire))
+      updates.push_back({it.key(), slot.value.load(std::memory_order_relaxed)});
+
+    it = finished ? slots.erase(it) : std::next(it);
+  }
+
+  if (slots.isEmpty())
+    timer.stop();
+  if (!updates.empty())
+    emit progressChanged(updates);
+}
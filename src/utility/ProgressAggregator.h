@@ -0,0 +1,54 @@
+#ifndef PROGRESSAGGREGATOR_H
+#define PROGRESSAGGREGATOR_H
+
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#include <QUuid>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct ProgressUpdate {
+  QUuid uuid;
+  int progress = 0;
+};
+
+// Progress of one job. Workers only store into it, they never lock or
+// queue an event, however often they report.
+class ProgressSlot {
+ public:
+  void set(int value) noexcept;
+  // Last report of the job, the slot is dropped once it was delivered.
+  void finish(int value) noexcept;
+
+ private:
+  friend class ProgressAggregator;
+
+  std::atomic_int value{0};
+  std::atomic_bool changed{false};
+  std::atomic_bool finished{false};
+};
+
+// Collects the slots of all jobs and delivers what changed since the last
+// tick as one batch, at a fixed rate on the thread it lives in. track is
+// called on that thread too, only the slots are shared with workers.
+class ProgressAggregator : public QObject {
+  Q_OBJECT
+ public:
+  explicit ProgressAggregator(QObject* parent = nullptr);
+
+  std::shared_ptr<ProgressSlot> track(QUuid uuid);
+  void setInterval(int intervalMs);
+
+ signals:
+  void progressChanged(const std::vector<ProgressUpdate>& updates);
+
+ private:
+  void tick();
+
+  QHash<QUuid, std::shared_ptr<ProgressSlot>> slots;
+  QTimer timer;
+};
+
+#endif  // PROGRESSAGGREGATOR_H
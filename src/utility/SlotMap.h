@@ -0,0 +1,153 @@
+#ifndef SLOTMAP_H
+#define SLOTMAP_H
+
+#include <QHash>
+#include <QUuid>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Items stored densely in insertion order, addressed by position for views
+// and by handle or uuid for everything else. Handles stay valid while other
+// items are removed and go stale, never dangling, when their own item is:
+// every slot carries a generation that is bumped when the slot is reused.
+template <class T>
+class SlotMap {
+ public:
+  struct Handle {
+    uint32_t slot = std::numeric_limits<uint32_t>::max();
+    uint32_t generation = 0;
+
+    bool operator==(const Handle& other) const noexcept {
+      return slot == other.slot && generation == other.generation;
+    }
+    bool operator!=(const Handle& other) const noexcept {
+      return !(*this == other);
+    }
+  };
+
+  Handle insert(T value, QUuid uuid = QUuid::createUuid()) {
+    uint32_t slot = 0;
+    if (freeSlots.empty()) {
+      slot = static_cast<uint32_t>(slots.size());
+      slots.push_back({});
+    } else {
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+    }
+
+    slots[slot].index = static_cast<uint32_t>(values.size());
+    values.push_back(std::move(value));
+    denseSlots.push_back(slot);
+    uuids.push_back(uuid);
+
+    const Handle handle{slot, slots[slot].generation};
+    byUuid.insert(uuids.back(), handle);
+    return handle;
+  }
+
+  // O(1), moves the last item into the gap, so positions change.
+  bool erase(Handle handle) {
+    const auto index = indexOf(handle);
+    if (index < 0)
+      return false;
+
+    const auto last = values.size() - 1;
+    release(static_cast<size_t>(index));
+    if (static_cast<size_t>(index) != last)
+      moveItem(last, static_cast<size_t>(index));
+    shrinkTo(last);
+    return true;
+  }
+
+  // Keeps the order of the remaining items, one pass over the items after
+  // the range however many are removed.
+  void eraseAt(size_t first, size_t count = 1) {
+    if (first >= values.size())
+      return;
+    count = std::min(count, values.size() - first);
+
+    for (auto i = first; i < first + count; ++i)
+      release(i);
+    for (auto i = first + count; i < values.size(); ++i)
+      moveItem(i, i - count);
+    shrinkTo(values.size() - count);
+  }
+
+  void clear() {
+    for (size_t i = 0; i < values.size(); ++i)
+      release(i);
+    shrinkTo(0);
+  }
+
+  // Position of the item, -1 when the handle is stale.
+  int indexOf(Handle handle) const noexcept {
+    if (handle.slot >= slots.size() ||
+        slots[handle.slot].generation != handle.generation ||
+        slots[handle.slot].index == Free)
+      return -1;
+    return static_cast<int>(slots[handle.slot].index);
+  }
+  int indexOf(QUuid uuid) const { return indexOf(byUuid.value(uuid)); }
+
+  bool contains(Handle handle) const noexcept { return indexOf(handle) >= 0; }
+  bool contains(QUuid uuid) const { return byUuid.contains(uuid); }
+
+  Handle handleAt(size_t index) const {
+    return {denseSlots[index], slots[denseSlots[index]].generation};
+  }
+  QUuid uuidAt(size_t index) const { return uuids[index]; }
+
+  size_t size() const noexcept { return values.size(); }
+  bool empty() const noexcept { return values.empty(); }
+
+  const T& operator[](size_t index) const { return values[index]; }
+  T& operator[](size_t index) { return values[index]; }
+
+  auto begin() noexcept { return values.begin(); }
+  auto end() noexcept { return values.end(); }
+  auto begin() const noexcept { return values.begin(); }
+  auto end() const noexcept { return values.end(); }
+
+ private:
+  static constexpr auto Free = std::numeric_limits<uint32_t>::max();
+
+  struct Slot {
+    uint32_t index = Free;
+    uint32_t generation = 0;
+  };
+
+  // Invalidates the handle and uuid of the item at index, the item itself
+  // is dropped by shrinkTo.
+  void release(size_t index) {
+    auto& slot = slots[denseSlots[index]];
+    slot.index = Free;
+    ++slot.generation;
+    freeSlots.push_back(denseSlots[index]);
+    byUuid.remove(uuids[index]);
+  }
+
+  void moveItem(size_t from, size_t to) {
+    values[to] = std::move(values[from]);
+    denseSlots[to] = denseSlots[from];
+    uuids[to] = uuids[from];
+    slots[denseSlots[to]].index = static_cast<uint32_t>(to);
+  }
+
+  void shrinkTo(size_t count) {
+    values.erase(values.begin() + count, values.end());
+    denseSlots.resize(count);
+    uuids.resize(count);
+  }
+
+  std::vector<T> values;
+  std::vector<uint32_t> denseSlots;
+  std::vector<QUuid> uuids;
+  std::vector<Slot> slots;
+  std::vector<uint32_t> freeSlots;
+  QHash<QUuid, Handle> byUuid;
+};
+
+#endif  // SLOTMAP_H
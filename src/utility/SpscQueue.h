@@ -0,0 +1,87 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Bounded ring buffer for exactly one producer and one consumer thread.
+// push blocks while the queue is full, pop blocks while it is empty. The
+// mutex is only taken when one side actually has to sleep.
+template <class T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : slots(std::max<size_t>(capacity, 1)) {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Returns false without taking the value once the queue is closed.
+  bool push(T value) {
+    const auto t = tail.load(std::memory_order_relaxed);
+    waitFor([this, t] { return closed || t - head < slots.size(); });
+    if (closed)
+      return false;
+
+    slots[t % slots.size()] = std::move(value);
+    tail.store(t + 1);
+    wake();
+    return true;
+  }
+
+  // Returns false once the queue is closed and drained.
+  bool pop(T& value) {
+    const auto h = head.load(std::memory_order_relaxed);
+    waitFor([this, h] { return closed || h != tail; });
+    if (h == tail)
+      return false;
+
+    value = std::move(slots[h % slots.size()]);
+    slots[h % slots.size()] = T();
+    head.store(h + 1);
+    wake();
+    return true;
+  }
+
+  // Wakes both sides, further pushes fail and pop drains what is left.
+  void close() {
+    closed = true;
+    std::lock_guard lock(mutex);
+    changed.notify_all();
+  }
+
+  size_t capacity() const noexcept { return slots.size(); }
+
+ private:
+  template <class Predicate>
+  void waitFor(Predicate ready) {
+    if (ready())
+      return;
+
+    std::unique_lock lock(mutex);
+    ++waiters;
+    changed.wait(lock, ready);
+    --waiters;
+  }
+
+  void wake() {
+    if (waiters == 0)
+      return;
+
+    std::lock_guard lock(mutex);
+    changed.notify_all();
+  }
+
+  std::vector<T> slots;
+  std::atomic<size_t> head = 0;
+  std::atomic<size_t> tail = 0;
+  std::atomic_bool closed = false;
+  std::atomic<int> waiters = 0;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
+
+#endif  // SPSCQUEUE_H
@@ -0,0 +1,80 @@
+#include "ThreadBudget.h"
+
+#include <algorithm>
+#include <thread>
+
+ThreadBudget::Lease::Lease(ThreadBudget* owner, int threads)
+    : owner(owner), threads(threads) {}
+
+ThreadBudget::Lease::Lease(Lease&& other) noexcept
+    : owner(other.owner), threads(other.threads) {
+  other.owner = nullptr;
+}
+
+ThreadBudget::Lease& ThreadBudget::Lease::operator=(Lease&& other) noexcept {
+  if (this != &other) {
+    reset();
+    owner = other.owner;
+    threads = other.threads;
+    other.owner = nullptr;
+  }
+  return *this;
+}
+
+ThreadBudget::Lease::~Lease() {
+  reset();
+}
+
+int ThreadBudget::Lease::getThreads() const noexcept {
+  return threads;
+}
+
+void ThreadBudget::Lease::reset() {
+  if (owner)
+    owner->release(threads);
+  owner = nullptr;
+}
+
+ThreadBudget::ThreadBudget(int total) : total(std::max(total, 1)) {}
+
+void ThreadBudget::setTotal(int value) {
+  {
+    std::lock_guard lock(mutex);
+    total = std::max(value, 1);
+  }
+  freed.notify_all();
+}
+
+int ThreadBudget::getTotal() const {
+  std::lock_guard lock(mutex);
+  return total;
+}
+
+ThreadBudget::Lease ThreadBudget::acquire(int wanted,
+                                          int expectedJobs,
+                                          int minimum) {
+  std::unique_lock lock(mutex);
+  auto least = 1;
+  freed.wait(lock, [&] {
+    least = std::clamp(minimum, 1, total);
+    return total - used >= least;
+  });
+
+  const auto share = std::max(total / std::max(expectedJobs, 1), 1);
+  const auto threads = std::clamp(std::min(wanted, share), least, total - used);
+  used += threads;
+
+  return Lease(this, threads);
+}
+
+int ThreadBudget::defaultTotal() {
+  return static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+}
+
+void ThreadBudget::release(int threads) {
+  {
+    std::lock_guard lock(mutex);
+    used -= threads;
+  }
+  freed.notify_all();
+}
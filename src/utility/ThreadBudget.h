@@ -0,0 +1,54 @@
+#ifndef THREADBUDGET_H
+#define THREADBUDGET_H
+
+#include <condition_variable>
+#include <mutex>
+
+// Splits a fixed number of threads between concurrently running jobs, so
+// that the threads handed to codecs of all jobs never exceed the machine.
+// A lone large job gets most of the budget, a crowd of jobs one thread each.
+class ThreadBudget {
+ public:
+  class Lease {
+   public:
+    Lease() = default;
+    Lease(Lease&& other) noexcept;
+    Lease& operator=(Lease&& other) noexcept;
+    ~Lease();
+
+    int getThreads() const noexcept;
+
+   private:
+    friend class ThreadBudget;
+    Lease(ThreadBudget* owner, int threads);
+    void reset();
+
+    ThreadBudget* owner = nullptr;
+    int threads = 1;
+  };
+
+  explicit ThreadBudget(int total = defaultTotal());
+
+  ThreadBudget(const ThreadBudget&) = delete;
+  ThreadBudget& operator=(const ThreadBudget&) = delete;
+
+  void setTotal(int value);
+  int getTotal() const;
+
+  // Blocks until minimum threads are free, or the whole budget when it
+  // is smaller. Grants at most wanted threads and at most a fair share when
+  // expectedJobs run side by side, but never less than that minimum.
+  Lease acquire(int wanted, int expectedJobs, int minimum = 1);
+
+  static int defaultTotal();
+
+ private:
+  void release(int threads);
+
+  mutable std::mutex mutex;
+  std::condition_variable freed;
+  int total = 1;
+  int used = 0;
+};
+
+#endif  // THREADBUDGET_H
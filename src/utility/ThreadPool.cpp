@@ -0,0 +1,118 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#include "Tracer.h"
+
+ThreadPool::ThreadPool(size_t threadCount) {
+  threadCount = std::max<size_t>(threadCount, 1);
+  maxConcurrency = threadCount;
+  workers.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; ++i) {
+    workers.emplace_back(&ThreadPool::run, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  stop();
+}
+
+void ThreadPool::push(Job job, int priority, int64_t cost) {
+  {
+    std::lock_guard lock(mutex);
+    if (stopping)
+      return;
+    jobs.emplace(Order{-priority, cost, pushed++}, std::move(job));
+  }
+  jobAvailable.notify_one();
+}
+
+void ThreadPool::setMaxConcurrency(size_t value) {
+  {
+    std::lock_guard lock(mutex);
+    maxConcurrency = std::clamp<size_t>(value, 1, workers.size());
+  }
+  jobAvailable.notify_all();
+}
+
+size_t ThreadPool::getMaxConcurrency() const {
+  std::lock_guard lock(mutex);
+  return maxConcurrency;
+}
+
+size_t ThreadPool::getThreadCount() const noexcept {
+  return workers.size();
+}
+
+size_t ThreadPool::pendingCount() const {
+  std::lock_guard lock(mutex);
+  return jobs.size();
+}
+
+size_t ThreadPool::runningCount() const {
+  std::lock_guard lock(mutex);
+  return running;
+}
+
+void ThreadPool::clear() {
+  {
+    std::lock_guard lock(mutex);
+    jobs.clear();
+  }
+  jobsDone.notify_all();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock lock(mutex);
+  jobsDone.wait(lock, [this] { return jobs.empty() && running == 0; });
+}
+
+void ThreadPool::stop() {
+  {
+    std::lock_guard lock(mutex);
+    if (stopping && workers.empty())
+      return;
+    stopping = true;
+    jobs.clear();
+  }
+  jobAvailable.notify_all();
+
+  for (auto& worker : workers) {
+    if (worker.joinable())
+      worker.join();
+  }
+  workers.clear();
+}
+
+size_t ThreadPool::defaultThreadCount() {
+  return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void ThreadPool::run() {
+  Tracer::setThreadName("pool worker");
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock lock(mutex);
+      jobAvailable.wait(lock, [this] {
+        return stopping || (!jobs.empty() && running < maxConcurrency);
+      });
+      if (stopping)
+        return;
+
+      const auto next = jobs.begin();
+      job = std::move(next->second);
+      jobs.erase(next);
+      ++running;
+    }
+
+    job();
+
+    {
+      std::lock_guard lock(mutex);
+      --running;
+    }
+    jobAvailable.notify_one();
+    jobsDone.notify_all();
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+class ThreadPool {
+ public:
+  using Job = std::function<void()>;
+
+  explicit ThreadPool(size_t threadCount = defaultThreadCount());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Queued jobs start by higher priority first, then by lower cost, and
+  // in push order when both are equal.
+  void push(Job job, int priority = 0, int64_t cost = 0);
+
+  // Limits how many jobs run at the same time, never above the thread count.
+  void setMaxConcurrency(size_t value);
+  size_t getMaxConcurrency() const;
+  size_t getThreadCount() const noexcept;
+
+  size_t pendingCount() const;
+  size_t runningCount() const;
+
+  // Drops queued jobs that have not started yet.
+  void clear();
+  // Blocks until the queue is empty and no job is running.
+  void wait();
+  // Drops queued jobs, waits for running ones and joins all workers.
+  void stop();
+
+  static size_t defaultThreadCount();
+
+ private:
+  void run();
+
+  // Negated priority, cost and push sequence, so begin() runs next.
+  using Order = std::tuple<int, int64_t, uint64_t>;
+
+  std::vector<std::thread> workers;
+  std::map<Order, Job> jobs;
+  uint64_t pushed = 0;
+  mutable std::mutex mutex;
+  std::condition_variable jobAvailable;
+  std::condition_variable jobsDone;
+  size_t maxConcurrency = 0;
+  size_t running = 0;
+  bool stopping = false;
+};
+
+#endif  // THREADPOOL_H
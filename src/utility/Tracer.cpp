@@ -0,0 +1,180 @@
+#include "Tracer.h"
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+constexpr auto ProcessId = 1;
+
+}  // namespace
+
+std::atomic_bool Tracer::enabled{false};
+thread_local Tracer::ThreadSlot Tracer::threadSlot;
+
+Tracer::ThreadSlot::~ThreadSlot() {
+  if (buffer)
+    buffer->exited.store(true, std::memory_order_release);
+}
+
+Tracer& Tracer::shared() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::setEnabled(bool value) noexcept {
+  enabled.store(value, std::memory_order_relaxed);
+}
+
+int64_t Tracer::now() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Tracer::setThreadName(std::string name) {
+  if (threadSlot.buffer) {
+    auto& tracer = shared();
+    std::lock_guard lock(tracer.mutex);
+    threadSlot.buffer->threadName = name;
+  }
+  threadSlot.name = std::move(name);
+}
+
+void Tracer::record(const char* name,
+                    const char* category,
+                    int64_t beginNs,
+                    int64_t endNs,
+                    const char* argName,
+                    int64_t argValue) {
+  auto& buffer = threadBuffer();
+  const auto index = buffer.head.load(std::memory_order_relaxed);
+  auto& event = buffer.events[index % EventsPerThread];
+
+  // Sequence 0 marks the slot as being written.
+  event.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  event.name.store(name, std::memory_order_relaxed);
+  event.category.store(category, std::memory_order_relaxed);
+  event.argName.store(argName, std::memory_order_relaxed);
+  event.argValue.store(argValue, std::memory_order_relaxed);
+  event.beginNs.store(beginNs, std::memory_order_relaxed);
+  event.endNs.store(endNs, std::memory_order_relaxed);
+  event.threadId.store(buffer.threadId, std::memory_order_relaxed);
+  event.sequence.store(index + 1, std::memory_order_release);
+  buffer.head.store(index + 1, std::memory_order_release);
+}
+
+bool Tracer::write(const QString& fileName, int64_t sinceNs) {
+  std::vector<std::shared_ptr<ThreadBuffer>> snapshot;
+  QJsonArray events;
+  const auto nameThread = [&events](int threadId, const std::string& name) {
+    events.append(QJsonObject{
+        {"name", "thread_name"},
+        {"ph", "M"},
+        {"pid", ProcessId},
+        {"tid", threadId},
+        {"args", QJsonObject{{"name", name.empty()
+                                          ? QString("thread %1").arg(threadId)
+                                          : QString::fromStdString(name)}}}});
+  };
+  {
+    std::lock_guard lock(mutex);
+    snapshot = buffers;
+    for (const auto& buffer : buffers)
+      nameThread(buffer->threadId, buffer->threadName);
+    // Events of a retired thread that did not make it into this trace
+    // are older than any later one asks for.
+    for (const auto& [threadId, name] : retiredThreads)
+      nameThread(threadId, name);
+    retiredThreads.clear();
+  }
+
+  for (const auto& buffer : snapshot) {
+    const auto head = buffer->head.load(std::memory_order_acquire);
+    const auto first = head > EventsPerThread ? head - EventsPerThread : 0;
+    for (auto index = first; index < head; ++index) {
+      auto& event = buffer->events[index % EventsPerThread];
+      const auto sequence = event.sequence.load(std::memory_order_acquire);
+      const auto* name = event.name.load(std::memory_order_relaxed);
+      const auto* category = event.category.load(std::memory_order_relaxed);
+      const auto* argName = event.argName.load(std::memory_order_relaxed);
+      const auto argValue = event.argValue.load(std::memory_order_relaxed);
+      const auto beginNs = event.beginNs.load(std::memory_order_relaxed);
+      const auto endNs = event.endNs.load(std::memory_order_relaxed);
+      const auto threadId = event.threadId.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      // Overwritten by the owner while we copied it.
+      if (sequence != index + 1 ||
+          event.sequence.load(std::memory_order_relaxed) != sequence) {
+        continue;
+      }
+      if (beginNs < sinceNs)
+        continue;
+
+      QJsonObject object{{"name", name},
+                         {"cat", category},
+                         {"ph", "X"},
+                         {"pid", ProcessId},
+                         {"tid", threadId},
+                         {"ts", (beginNs - sinceNs) / 1000.0},
+                         {"dur", (endNs - beginNs) / 1000.0}};
+      if (argName) {
+        object.insert("args",
+                      QJsonObject{{argName, static_cast<qint64>(argValue)}});
+      }
+      events.append(object);
+    }
+  }
+
+  {
+    std::lock_guard lock(mutex);
+    buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                                 [](const auto& buffer) {
+                                   return buffer->exited.load(
+                                       std::memory_order_acquire);
+                                 }),
+                  buffers.end());
+  }
+
+  QSaveFile file(fileName);
+  if (!file.open(QFile::WriteOnly)) {
+    qDebug() << "failed to write trace" << fileName;
+    return false;
+  }
+  const QJsonObject document{{"traceEvents", events},
+                             {"displayTimeUnit", "ms"}};
+  file.write(QJsonDocument(document).toJson(QJsonDocument::Compact));
+  return file.commit();
+}
+
+Tracer::ThreadBuffer& Tracer::threadBuffer() {
+  if (threadSlot.buffer)
+    return *threadSlot.buffer;
+
+  std::lock_guard lock(mutex);
+  const auto exited =
+      std::find_if(buffers.begin(), buffers.end(), [](const auto& buffer) {
+        return buffer->exited.load(std::memory_order_acquire);
+      });
+  if (exited != buffers.end()) {
+    // Taken over with the events still in it, they keep their thread id.
+    auto& buffer = *exited;
+    retiredThreads.emplace_back(buffer->threadId,
+                                std::move(buffer->threadName));
+    buffer->exited.store(false, std::memory_order_relaxed);
+    threadSlot.buffer = buffer;
+  } else {
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->events = std::make_unique<Event[]>(EventsPerThread);
+    buffers.push_back(buffer);
+    threadSlot.buffer = std::move(buffer);
+  }
+  threadSlot.buffer->threadId = nextThreadId++;
+  threadSlot.buffer->threadName = threadSlot.name;
+  return *threadSlot.buffer;
+}
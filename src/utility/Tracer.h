@@ -0,0 +1,123 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Records complete events into a ring buffer per thread and writes them as
+// Chrome trace-event JSON, which chrome://tracing and Perfetto open. Only
+// the owning thread writes its buffer, so recording never locks, and the
+// oldest events are overwritten once a buffer wraps. The buffer of a thread
+// that exited goes to the next thread that records, so short-lived threads
+// cost no more memory than those alive at once. While disabled a
+// TraceScope costs a relaxed load.
+class Tracer {
+ public:
+  static Tracer& shared();
+
+  static bool isEnabled() noexcept {
+    return enabled.load(std::memory_order_relaxed);
+  }
+  static void setEnabled(bool value) noexcept;
+  // Steady clock nanoseconds, the time base of every event.
+  static int64_t now() noexcept;
+  // Shown as the name of the calling thread in the trace.
+  static void setThreadName(std::string name);
+
+  // Names, categories and argument names are kept by pointer, pass string
+  // literals. argName may be null.
+  void record(const char* name,
+              const char* category,
+              int64_t beginNs,
+              int64_t endNs,
+              const char* argName = nullptr,
+              int64_t argValue = 0);
+
+  // Writes the events that began at sinceNs or later. Buffers of threads
+  // that exited since are dropped afterwards.
+  bool write(const QString& fileName, int64_t sinceNs = 0);
+
+  static constexpr size_t EventsPerThread = 1 << 15;
+
+ private:
+  // Fields are atomics so the exporter may read a slot the owner is
+  // overwriting, sequence tells it whether the copy is torn.
+  struct Event {
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<const char*> name{nullptr};
+    std::atomic<const char*> category{nullptr};
+    std::atomic<const char*> argName{nullptr};
+    std::atomic<int64_t> argValue{0};
+    std::atomic<int64_t> beginNs{0};
+    std::atomic<int64_t> endNs{0};
+    // The buffer outlives the thread that recorded the event.
+    std::atomic<int> threadId{0};
+  };
+
+  struct ThreadBuffer {
+    // Of the thread writing the buffer now, under the mutex.
+    int threadId = 0;
+    std::string threadName;
+    std::atomic<uint64_t> head{0};
+    std::atomic_bool exited{false};
+    std::unique_ptr<Event[]> events;
+  };
+
+  // Marks the buffer exited when its thread ends.
+  struct ThreadSlot {
+    ~ThreadSlot();
+
+    std::shared_ptr<ThreadBuffer> buffer;
+    std::string name;
+  };
+
+  ThreadBuffer& threadBuffer();
+
+  static std::atomic_bool enabled;
+  static thread_local ThreadSlot threadSlot;
+
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  // Ids and names of exited threads whose buffer was taken over, their
+  // events may still be in it.
+  std::vector<std::pair<int, std::string>> retiredThreads;
+  int nextThreadId = 1;
+};
+
+// Records the lifetime of the scope as one event.
+class TraceScope {
+ public:
+  TraceScope(const char* name, const char* category) noexcept
+      : name(Tracer::isEnabled() ? name : nullptr),
+        category(category),
+        beginNs(this->name ? Tracer::now() : 0) {}
+  ~TraceScope() {
+    if (name) {
+      Tracer::shared().record(name, category, beginNs, Tracer::now(), argName,
+                              argValue);
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  void setArg(const char* name, int64_t value) noexcept {
+    argName = name;
+    argValue = value;
+  }
+
+ private:
+  const char* name;
+  const char* category;
+  int64_t beginNs;
+  const char* argName = nullptr;
+  int64_t argValue = 0;
+};
+
+#endif  // TRACER_H
@@ -0,0 +1,76 @@
+#include <QTemporaryDir>
+#include <QUuid>
+#include <QtTest>
+
+#include "converter/BatchJournal.h"
+
+class BatchJournalTest : public QObject {
+  Q_OBJECT
+
+ private slots:
+  // A job that was running each time the process died is resumed until
+  // MaxAttempts and given up after, even though every resume queues it
+  // again.
+  void abandonsJobAfterRepeatedCrashes() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const auto fileName = directory.filePath("journal.jsonl");
+    const auto outputDir = directory.path();
+
+    VideoProp prop;
+    prop.uuid = QUuid::createUuid();
+    prop.path = "clip.mp4";
+    prop.endPosMs = 3000;
+
+    {
+      BatchJournal journal(fileName);
+      journal.queued(prop, outputDir);
+      journal.running(prop.uuid);
+    }
+
+    for (int session = 1; session < BatchJournal::MaxAttempts; ++session) {
+      BatchJournal journal(fileName);
+      QCOMPARE(journal.unfinished().size(), size_t(1));
+      QVERIFY(journal.abandoned().empty());
+      // What resume does through ToWebmConvertor::push.
+      journal.queued(journal.unfinished().front().prop, outputDir);
+      journal.running(prop.uuid);
+    }
+
+    BatchJournal journal(fileName);
+    QVERIFY(journal.unfinished().empty());
+    QCOMPARE(journal.abandoned().size(), size_t(1));
+    QCOMPARE(journal.abandoned().front().prop.uuid, prop.uuid);
+    QCOMPARE(journal.abandoned().front().attempts, BatchJournal::MaxAttempts);
+  }
+
+  // Runs cut short by shutting down do not count as attempts.
+  void keepsJobInterruptedByShutdown() {
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const auto fileName = directory.filePath("journal.jsonl");
+
+    VideoProp prop;
+    prop.uuid = QUuid::createUuid();
+    prop.path = "clip.mp4";
+
+    {
+      BatchJournal journal(fileName);
+      journal.queued(prop, directory.path());
+    }
+    for (int session = 0; session < BatchJournal::MaxAttempts; ++session) {
+      BatchJournal journal(fileName);
+      QCOMPARE(journal.unfinished().size(), size_t(1));
+      journal.queued(journal.unfinished().front().prop, directory.path());
+      journal.running(prop.uuid);
+      journal.interrupted(prop.uuid);
+    }
+
+    BatchJournal journal(fileName);
+    QCOMPARE(journal.unfinished().size(), size_t(1));
+    QVERIFY(journal.abandoned().empty());
+  }
+};
+
+QTEST_GUILESS_MAIN(BatchJournalTest)
+#include "BatchJournalTest.moc"